@@ -0,0 +1,251 @@
+/*
+ * Batched bot decisions: chase the nearest other player, attack when adjacent.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include "bot.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BOT_HAVE_X86 1
+#endif
+
+static const int DIRS[4][2] = { {-1, 0}, {1, 0}, {0, -1}, {0, 1} };
+
+// Find the slot nearest to (r, c) by Manhattan distance, skipping <self>.
+// Ties go to the lowest slot index. Writes the distance to *dist.
+typedef int (*NearestFn)(const int32_t *row, const int32_t *col, int n,
+                         int self, int32_t r, int32_t c, int32_t *dist);
+
+// -------- Kernels --------
+static int nearest_scalar(const int32_t *row, const int32_t *col, int n,
+                          int self, int32_t r, int32_t c, int32_t *dist) {
+    int best = -1;
+    int32_t best_dist = INT32_MAX;
+    for (int q = 0; q < n; ++q) {
+        if (q == self) continue;
+        int32_t d = abs(row[q] - r) + abs(col[q] - c);
+        if (d < best_dist) {
+            best = q;
+            best_dist = d;
+        }
+    }
+    *dist = best_dist;
+    return best;
+}
+
+#ifdef BOT_HAVE_X86
+// Fold per-lane minima (and the lowest index achieving each) into one result
+// and finish the tail that did not fill a vector.
+static int reduce_lanes(const int32_t *lane_dist, const int32_t *lane_idx, int lanes,
+                        const int32_t *row, const int32_t *col, int from, int n,
+                        int self, int32_t r, int32_t c, int32_t *dist) {
+    int best = -1;
+    int32_t best_dist = INT32_MAX;
+    for (int l = 0; l < lanes; ++l) {
+        if (lane_idx[l] < 0) continue;
+        if (lane_dist[l] < best_dist || (lane_dist[l] == best_dist && lane_idx[l] < best)) {
+            best = lane_idx[l];
+            best_dist = lane_dist[l];
+        }
+    }
+    for (int q = from; q < n; ++q) {
+        if (q == self) continue;
+        int32_t d = abs(row[q] - r) + abs(col[q] - c);
+        if (d < best_dist) {
+            best = q;
+            best_dist = d;
+        }
+    }
+    *dist = best_dist;
+    return best;
+}
+
+__attribute__((target("sse4.1")))
+static int nearest_sse41(const int32_t *row, const int32_t *col, int n,
+                         int self, int32_t r, int32_t c, int32_t *dist) {
+    const __m128i vr = _mm_set1_epi32(r), vc = _mm_set1_epi32(c);
+    const __m128i vself = _mm_set1_epi32(self), big = _mm_set1_epi32(INT32_MAX);
+    const __m128i step = _mm_set1_epi32(4);
+    __m128i idx = _mm_setr_epi32(0, 1, 2, 3);
+    __m128i best = big, best_idx = _mm_set1_epi32(-1);
+    int q = 0;
+    for (; q + 4 <= n; q += 4) {
+        __m128i dr = _mm_abs_epi32(_mm_sub_epi32(_mm_loadu_si128((const __m128i *)(row + q)), vr));
+        __m128i dc = _mm_abs_epi32(_mm_sub_epi32(_mm_loadu_si128((const __m128i *)(col + q)), vc));
+        __m128i d = _mm_add_epi32(dr, dc);
+        d = _mm_max_epi32(d, _mm_and_si128(_mm_cmpeq_epi32(idx, vself), big));
+        __m128i closer = _mm_cmplt_epi32(d, best);
+        best = _mm_min_epi32(best, d);
+        best_idx = _mm_blendv_epi8(best_idx, idx, closer);
+        idx = _mm_add_epi32(idx, step);
+    }
+    int32_t lane_dist[4], lane_idx[4];
+    _mm_storeu_si128((__m128i *)lane_dist, best);
+    _mm_storeu_si128((__m128i *)lane_idx, best_idx);
+    return reduce_lanes(lane_dist, lane_idx, 4, row, col, q, n, self, r, c, dist);
+}
+
+__attribute__((target("avx2")))
+static int nearest_avx2(const int32_t *row, const int32_t *col, int n,
+                        int self, int32_t r, int32_t c, int32_t *dist) {
+    const __m256i vr = _mm256_set1_epi32(r), vc = _mm256_set1_epi32(c);
+    const __m256i vself = _mm256_set1_epi32(self), big = _mm256_set1_epi32(INT32_MAX);
+    const __m256i step = _mm256_set1_epi32(8);
+    __m256i idx = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i best = big, best_idx = _mm256_set1_epi32(-1);
+    int q = 0;
+    for (; q + 8 <= n; q += 8) {
+        __m256i dr = _mm256_abs_epi32(_mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)(row + q)), vr));
+        __m256i dc = _mm256_abs_epi32(_mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)(col + q)), vc));
+        __m256i d = _mm256_add_epi32(dr, dc);
+        d = _mm256_max_epi32(d, _mm256_and_si256(_mm256_cmpeq_epi32(idx, vself), big));
+        __m256i closer = _mm256_cmpgt_epi32(best, d);
+        best = _mm256_min_epi32(best, d);
+        best_idx = _mm256_blendv_epi8(best_idx, idx, closer);
+        idx = _mm256_add_epi32(idx, step);
+    }
+    int32_t lane_dist[8], lane_idx[8];
+    _mm256_storeu_si256((__m256i *)lane_dist, best);
+    _mm256_storeu_si256((__m256i *)lane_idx, best_idx);
+    return reduce_lanes(lane_dist, lane_idx, 8, row, col, q, n, self, r, c, dist);
+}
+#endif
+
+// -------- Kernel Selection --------
+typedef struct {
+    const char *name;
+    NearestFn fn;
+    int (*supported)(void);
+} Kernel;
+
+static int always(void) { return 1; }
+#ifdef BOT_HAVE_X86
+static int have_avx2(void) { __builtin_cpu_init(); return __builtin_cpu_supports("avx2"); }
+static int have_sse41(void) { __builtin_cpu_init(); return __builtin_cpu_supports("sse4.1"); }
+#endif
+
+// Ordered best first
+static const Kernel KERNELS[] = {
+#ifdef BOT_HAVE_X86
+    { "avx2", nearest_avx2, have_avx2 },
+    { "sse4.1", nearest_sse41, have_sse41 },
+#endif
+    { "scalar", nearest_scalar, always },
+};
+#define KERNEL_COUNT ((int)(sizeof(KERNELS) / sizeof(KERNELS[0])))
+
+static const Kernel *active_kernel = NULL;
+
+int bots_select_kernel(const char *name) {
+    for (int k = 0; k < KERNEL_COUNT; ++k) {
+        if ((!name || strcmp(name, KERNELS[k].name) == 0) && KERNELS[k].supported()) {
+            active_kernel = &KERNELS[k];
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char *bots_kernel_name(void) {
+    if (!active_kernel) bots_select_kernel(NULL);
+    return active_kernel->name;
+}
+
+// -------- Decisions --------
+int bots_decide(const BotView *v, BotIntent *out, unsigned int *rng) {
+    if (!active_kernel) bots_select_kernel(NULL);
+    NearestFn nearest = active_kernel->fn;
+    int n = 0;
+    for (int b = 0; b < v->count; ++b) {
+        if (v->row[b] == BOT_FAR || !v->is_bot[b]) continue;
+        int32_t best_dist;
+        int best = nearest(v->row, v->col, v->count, b, v->row[b], v->col[b], &best_dist);
+        if (best_dist >= BOT_FAR) best = -1; // only inactive slots left
+        BotIntent *it = &out[n++];
+        it->slot = b;
+        it->action = BOT_IDLE;
+        it->dr = it->dc = 0;
+        if (best >= 0 && best_dist == 1) {
+            it->action = BOT_ATTACK;
+            continue;
+        }
+        // Score each direction: distance to the target after the step, or a
+        // random preference when there is nobody to chase. Walls and
+        // obstacles are never chosen; occupancy is left to the move rules.
+        int best_score = 0, chosen = -1;
+        for (int d = 0; d < 4; ++d) {
+            int r = v->row[b] + DIRS[d][0];
+            int c = v->col[b] + DIRS[d][1];
+            if (r < 0 || r >= v->grid_size || c < 0 || c >= v->grid_size) continue;
+            if (v->obstacles[r * v->grid_size + c]) continue;
+            int score = best >= 0
+                ? abs(v->row[best] - r) + abs(v->col[best] - c)
+                : rand_r(rng) % 16;
+            if (chosen < 0 || score < best_score) {
+                chosen = d;
+                best_score = score;
+            }
+        }
+        if (chosen >= 0) {
+            it->action = BOT_MOVE;
+            it->dr = DIRS[chosen][0];
+            it->dc = DIRS[chosen][1];
+        }
+    }
+    return n;
+}
+
+// -------- Benchmark --------
+void bots_benchmark(int bots, FILE *out) {
+    int grid = 256;
+    int *obstacles = calloc(grid * grid, sizeof(int));
+    int32_t *row = malloc(bots * sizeof(int32_t));
+    int32_t *col = malloc(bots * sizeof(int32_t));
+    int32_t *hp = malloc(bots * sizeof(int32_t));
+    unsigned char *is_bot = malloc(bots);
+    BotIntent *intents = malloc(bots * sizeof(BotIntent));
+    if (!obstacles || !row || !col || !hp || !is_bot || !intents) {
+        fprintf(stderr, "Benchmark: out of memory\n");
+        goto done;
+    }
+    unsigned int seed = 1;
+    for (int i = 0; i < bots; ++i) {
+        row[i] = rand_r(&seed) % grid;
+        col[i] = rand_r(&seed) % grid;
+        hp[i] = 100;
+        is_bot[i] = 1;
+    }
+    BotView view = { grid, obstacles, bots, row, col, hp, is_bot };
+    const Kernel *saved = active_kernel;
+    fprintf(out, "Bot decision benchmark: %d bots on a %dx%d grid\n", bots, grid, grid);
+    for (int k = 0; k < KERNEL_COUNT; ++k) {
+        if (!KERNELS[k].supported()) continue;
+        active_kernel = &KERNELS[k];
+        int ticks = 0;
+        unsigned int rng = 1;
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        double elapsed = 0;
+        // Run whole ticks for at least half a second
+        while (elapsed < 0.5) {
+            bots_decide(&view, intents, &rng);
+            ticks++;
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+        }
+        double ns_tick = elapsed * 1e9 / ticks;
+        fprintf(out, "  %-7s %12.0f ns/tick %10.0f ns/tick per 1k bots %8.1f ns/bot\n",
+                KERNELS[k].name, ns_tick, ns_tick * 1000.0 / bots, ns_tick / bots);
+    }
+    active_kernel = saved;
+done:
+    free(obstacles);
+    free(row);
+    free(col);
+    free(hp);
+    free(is_bot);
+    free(intents);
+}
@@ -0,0 +1,52 @@
+/*
+ * Server-side bot decision making.
+ * Bots are ordinary player slots without a socket. Once per tick the server
+ * hands every slot to bots_decide() as columns (structure of arrays) and gets
+ * back one intent per bot, which it applies with the same rules as a human
+ * MOVE or ATTACK.
+ *
+ * The nearest-enemy scan is the O(bots x players) part of a tick. It runs on
+ * an AVX2 or SSE4.1 kernel when the CPU supports one, picked once at startup
+ * through CPUID, and falls back to a portable scalar loop otherwise.
+ */
+#ifndef BOT_H
+#define BOT_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Coordinate stored in the row/col columns for inactive slots. It is far
+// enough away that no real player ever picks it as the nearest enemy.
+#define BOT_FAR (1 << 20)
+
+typedef struct {
+    int grid_size;
+    const int *obstacles;          // grid_size * grid_size cells, row-major
+    int count;                     // number of slots in each column
+    const int32_t *row, *col;      // BOT_FAR for inactive slots
+    const int32_t *hp;
+    const unsigned char *is_bot;   // only consulted for active slots
+} BotView;
+
+typedef enum { BOT_IDLE, BOT_MOVE, BOT_ATTACK } BotAction;
+
+typedef struct {
+    int slot;
+    BotAction action;
+    int dr, dc;                    // direction for BOT_MOVE
+} BotIntent;
+
+// Select the nearest-enemy kernel: "avx2", "sse4.1", "scalar", or NULL for
+// the best one the CPU supports. Returns 0 on success, -1 if unavailable.
+int bots_select_kernel(const char *name);
+const char *bots_kernel_name(void);
+
+// Decide one action for every active bot in a single batched pass.
+// out must have room for v->count intents; returns the number written.
+int bots_decide(const BotView *v, BotIntent *out, unsigned int *rng);
+
+// Time bots_decide() with every available kernel on a synthetic room of
+// <bots> bots and print the cost per tick and per 1k bots.
+void bots_benchmark(int bots, FILE *out);
+
+#endif
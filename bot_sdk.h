@@ -0,0 +1,65 @@
+/*
+ * Bot SDK: the C ABI between the client's bot host and decision plugins.
+ *
+ * A plugin is a shared object that exports bot_plugin_entry(). The host
+ * (./client --bots <plugin.so> <count> <ip> <port>) runs every bot on one
+ * event loop: it owns the sockets, parses each state frame into a BotState
+ * and asks the plugin for the next command about every BOT_THINK_MS. The
+ * plugin never sees protocol text or sockets.
+ *
+ * The server reads one command per message, so on_frame() returns at most
+ * one command per call. A blocked move does not change the state, so the
+ * host calls on_frame() again with the same state when no new frame came.
+ *
+ * Build a plugin with
+ *   gcc -Wall -Wextra -O2 -shared -fPIC my_bot.c -o my_bot.so
+ */
+#ifndef BOT_SDK_H
+#define BOT_SDK_H
+
+#define BOT_SDK_ABI 1
+#define BOT_MAX_SLOTS 26
+#define BOT_PLUGIN_SYMBOL "bot_plugin_entry"
+
+typedef struct {
+    int active;
+    int row, col;
+    int hp;
+} BotPlayer;
+
+typedef struct {
+    unsigned long version;       // state version of this frame
+    unsigned long tick;          // room tick of this frame
+    int grid_size;
+    int stride;                  // row stride of cells
+    const char *cells;           // 'X' = obstacle, '.' = free; see bot_cell()
+    int self;                    // our slot (A = 0)
+    BotPlayer players[BOT_MAX_SLOTS];
+} BotState;
+
+enum { BOT_MOVE, BOT_ATTACK };
+enum { BOT_UP, BOT_DOWN, BOT_LEFT, BOT_RIGHT };
+
+typedef struct {
+    int type;                    // BOT_MOVE or BOT_ATTACK
+    int dir;                     // BOT_MOVE only
+} BotCommand;
+
+typedef struct {
+    int abi;                     // BOT_SDK_ABI
+    const char *name;
+    // One instance per hosted bot; index counts from 0. create and destroy
+    // may be NULL for bots that keep no state.
+    void *(*create)(int index);
+    // Fill *out and return 1 to send a command, or return 0 to wait.
+    int (*on_frame)(void *bot, const BotState *state, BotCommand *out);
+    void (*destroy)(void *bot);
+} BotPlugin;
+
+const BotPlugin *bot_plugin_entry(void);
+
+static inline char bot_cell(const BotState *s, int row, int col) {
+    return s->cells[row * s->stride + col];
+}
+
+#endif
@@ -0,0 +1,342 @@
+/*
+ * Incremental checkpoint log. See checkpoint.h for the file format.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "checkpoint.h"
+
+struct CheckpointLog {
+    char path[256];
+    int fd;                  // open for appending, -1 until the first full image
+    long size;               // bytes in the log file
+    CheckpointHeader header; // room the log holds; magic[0] == 0 = none yet
+    uint32_t seq;            // last commit sequence
+    char *pending;           // records gathered by checkpoint_collect()
+    size_t pending_len, pending_cap;
+    int pending_full;        // pending is a full image, header included
+    int compacted;
+};
+
+static int64_t unix_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static void make_header(const Room *room, CheckpointHeader *h) {
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, CHECKPOINT_MAGIC, 8);
+    h->seed = room->seed;
+    h->grid_size = room->params.grid_size;
+    h->max_players = room->params.max_players;
+    h->max_hp = room->params.max_hp;
+    h->damage = room->params.damage;
+    h->chunk = ROOM_CHUNK;
+}
+
+// Bytes of a full image of room: header, every chunk, every slot, commit.
+static size_t full_size(const Room *room) {
+    size_t chunks = (size_t)room_chunks_per_side(room) * room_chunks_per_side(room);
+    return sizeof(CheckpointHeader) +
+           chunks * (sizeof(CheckpointRecord) + CHECKPOINT_CHUNK_BYTES) +
+           room->params.max_players * (sizeof(CheckpointRecord) + sizeof(CheckpointPlayer)) +
+           sizeof(CheckpointRecord) + sizeof(CheckpointCommit);
+}
+
+static void put(CheckpointLog *log, const void *data, size_t len) {
+    memcpy(log->pending + log->pending_len, data, len);
+    log->pending_len += len;
+}
+
+static void put_record(CheckpointLog *log, uint32_t kind, uint32_t index) {
+    CheckpointRecord rec = { kind, index };
+    put(log, &rec, sizeof(rec));
+}
+
+static void put_chunk(CheckpointLog *log, const Room *room, int chunk) {
+    uint8_t bits[CHECKPOINT_CHUNK_BYTES];
+    room_chunk_bits(room, chunk, bits);
+    put_record(log, CHECKPOINT_CHUNK, chunk);
+    put(log, bits, sizeof(bits));
+}
+
+static void put_player(CheckpointLog *log, const Room *room, int slot, const char *token) {
+    const Player *p = &room->players[slot];
+    CheckpointPlayer rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.row = p->row;
+    rec.col = p->col;
+    rec.hp = p->hp;
+    rec.active = p->active;
+    rec.is_bot = p->is_bot;
+    if (p->active) snprintf(rec.token, sizeof(rec.token), "%s", token);
+    put_record(log, CHECKPOINT_PLAYER, slot);
+    put(log, &rec, sizeof(rec));
+}
+
+CheckpointLog *checkpoint_open(const char *path) {
+    CheckpointLog *log = calloc(1, sizeof(*log));
+    if (!log) return NULL;
+    snprintf(log->path, sizeof(log->path), "%s", path);
+    log->fd = -1;
+    return log;
+}
+
+int checkpoint_collect(CheckpointLog *log, Room *room, const char (*tokens)[CHECKPOINT_TOKEN_LEN + 1]) {
+    CheckpointHeader h;
+    make_header(room, &h);
+    size_t image = full_size(room);
+    // A new room, a failed write or a log grown well past one image: start over
+    int full = log->fd < 0 || memcmp(&h, &log->header, sizeof(h)) != 0 ||
+               log->size > (long)(CHECKPOINT_COMPACT_RATIO * image);
+    int chunks = room_chunks_per_side(room) * room_chunks_per_side(room);
+    int dirty_chunks = 0;
+    for (int i = 0; i < chunks; ++i) dirty_chunks += room->chunk_dirty[i];
+    if (!full && dirty_chunks == 0 && room->player_dirty == 0) return 0;
+
+    // A full image bounds any checkpoint, so the buffer only grows with the map
+    if (image > log->pending_cap) {
+        char *grown = realloc(log->pending, image);
+        if (!grown) return 0;
+        log->pending = grown;
+        log->pending_cap = image;
+    }
+    log->pending_len = 0;
+    log->pending_full = full;
+    if (full) put(log, &h, sizeof(h));
+    int records = 0;
+    for (int i = 0; i < chunks; ++i) {
+        if (full || room->chunk_dirty[i]) {
+            put_chunk(log, room, i);
+            records++;
+        }
+    }
+    for (int slot = 0; slot < room->params.max_players; ++slot) {
+        if (full || (room->player_dirty & (1u << slot))) {
+            put_player(log, room, slot, tokens[slot]);
+            records++;
+        }
+    }
+    CheckpointCommit commit;
+    memset(&commit, 0, sizeof(commit));
+    commit.version = room->version;
+    commit.tick = room->tick;
+    commit.event_seq = room->event_seq;
+    commit.rng = room->rng;
+    commit.records = records;
+    commit.time_ms = unix_ms();
+    put_record(log, CHECKPOINT_COMMIT, ++log->seq);
+    put(log, &commit, sizeof(commit));
+
+    memset(room->chunk_dirty, 0, chunks);
+    room->player_dirty = 0;
+    log->header = h;
+    return records;
+}
+
+static int write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) return -1;
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Sync the directory holding path, so a rename() into it is durable.
+static int sync_dir(const char *path) {
+    char dir[256];
+    snprintf(dir, sizeof(dir), "%s", path);
+    char *slash = strrchr(dir, '/');
+    if (slash == dir) {
+        dir[1] = '\0';
+    } else if (slash) {
+        *slash = '\0';
+    } else {
+        snprintf(dir, sizeof(dir), ".");
+    }
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return -1;
+    int rc = fsync(fd);
+    close(fd);
+    return rc;
+}
+
+long checkpoint_flush(CheckpointLog *log) {
+    long len = log->pending_len;
+    log->compacted = 0;
+    if (len == 0) return 0;
+    if (log->pending_full) {
+        // Write the image beside the log and swap it in, so a crash leaves
+        // either the old log or the new one; the directory sync makes the
+        // swap itself survive a crash
+        char tmp[300];
+        snprintf(tmp, sizeof(tmp), "%s.tmp", log->path);
+        int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+        if (fd < 0 || write_all(fd, log->pending, len) < 0 || fsync(fd) < 0 ||
+            rename(tmp, log->path) < 0 || sync_dir(log->path) < 0) {
+            perror("Checkpoint: compaction");
+            if (fd >= 0) close(fd);
+            unlink(tmp);
+            goto fail;
+        }
+        if (log->fd >= 0) close(log->fd);
+        log->fd = fd;
+        log->size = len;
+        log->compacted = 1;
+    } else {
+        if (write_all(log->fd, log->pending, len) < 0 || fdatasync(log->fd) < 0) {
+            perror("Checkpoint: write");
+            goto fail;
+        }
+        log->size += len;
+    }
+    log->pending_len = 0;
+    log->pending_full = 0;
+    return len;
+fail:
+    // The dirty flags are gone with this data; the next checkpoint is a full image
+    memset(&log->header, 0, sizeof(log->header));
+    log->pending_len = 0;
+    log->pending_full = 0;
+    return -1;
+}
+
+int checkpoint_compacted(const CheckpointLog *log) {
+    return log->compacted;
+}
+
+static size_t payload_size(uint32_t kind) {
+    switch (kind) {
+    case CHECKPOINT_CHUNK: return CHECKPOINT_CHUNK_BYTES;
+    case CHECKPOINT_PLAYER: return sizeof(CheckpointPlayer);
+    case CHECKPOINT_COMMIT: return sizeof(CheckpointCommit);
+    }
+    return 0;
+}
+
+Room *checkpoint_restore(const char *path, char (*tokens)[CHECKPOINT_TOKEN_LEN + 1],
+                         char *err, size_t errlen) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        snprintf(err, errlen, "%s: no checkpoint log", path);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *data = size > 0 ? malloc(size) : NULL;
+    if (!data || fread(data, 1, size, f) != (size_t)size) {
+        snprintf(err, errlen, "%s: could not read the checkpoint log", path);
+        free(data);
+        fclose(f);
+        return NULL;
+    }
+    fclose(f);
+
+    CheckpointHeader h;
+    memset(&h, 0, sizeof(h));
+    if ((size_t)size >= sizeof(h)) memcpy(&h, data, sizeof(h));
+    if (memcmp(h.magic, CHECKPOINT_MAGIC, 8) != 0 || h.chunk != ROOM_CHUNK) {
+        snprintf(err, errlen, "%s: not a checkpoint log", path);
+        free(data);
+        return NULL;
+    }
+    RoomParams params;
+    params.grid_size = h.grid_size;
+    params.max_players = h.max_players;
+    params.max_hp = h.max_hp;
+    params.damage = h.damage;
+    Room *room = room_create(&params, h.seed);
+    if (!room) {
+        snprintf(err, errlen, "%s: invalid room parameters", path);
+        free(data);
+        return NULL;
+    }
+    // Find the end of the last complete checkpoint; anything after it is torn
+    int chunks = room_chunks_per_side(room) * room_chunks_per_side(room);
+    size_t committed = 0;
+    for (size_t off = sizeof(h); off + sizeof(CheckpointRecord) <= (size_t)size;) {
+        CheckpointRecord rec;
+        memcpy(&rec, data + off, sizeof(rec));
+        size_t len = payload_size(rec.kind);
+        if (len == 0 || off + sizeof(rec) + len > (size_t)size ||
+            (rec.kind == CHECKPOINT_CHUNK && rec.index >= (uint32_t)chunks) ||
+            (rec.kind == CHECKPOINT_PLAYER && rec.index >= (uint32_t)params.max_players)) {
+            break;
+        }
+        off += sizeof(rec) + len;
+        if (rec.kind == CHECKPOINT_COMMIT) committed = off;
+    }
+    if (committed == 0) {
+        snprintf(err, errlen, "%s: no complete checkpoint", path);
+        room_destroy(room);
+        free(data);
+        return NULL;
+    }
+
+    for (int i = 0; i < params.max_players; ++i) tokens[i][0] = '\0';
+    for (size_t off = sizeof(h); off < committed;) {
+        CheckpointRecord rec;
+        memcpy(&rec, data + off, sizeof(rec));
+        const char *payload = data + off + sizeof(rec);
+        off += sizeof(rec) + payload_size(rec.kind);
+        if (rec.kind == CHECKPOINT_CHUNK) {
+            room_load_chunk(room, rec.index, (const uint8_t *)payload);
+        } else if (rec.kind == CHECKPOINT_PLAYER) {
+            CheckpointPlayer cp;
+            memcpy(&cp, payload, sizeof(cp));
+            Player *p = &room->players[rec.index];
+            p->row = cp.row;
+            p->col = cp.col;
+            p->hp = cp.hp;
+            p->active = cp.active;
+            p->is_bot = cp.is_bot;
+            cp.token[CHECKPOINT_TOKEN_LEN] = '\0';
+            memcpy(tokens[rec.index], cp.token, sizeof(cp.token));
+        } else {
+            CheckpointCommit commit;
+            memcpy(&commit, payload, sizeof(commit));
+            room->version = commit.version;
+            room->tick = commit.tick;
+            room->event_seq = commit.event_seq;
+            room->rng = commit.rng;
+        }
+    }
+    free(data);
+
+    // A damaged or stale log must not put anyone off the grid, on an
+    // obstacle or on another player's cell; such players are dropped
+    int n = params.grid_size;
+    for (int q = 0; q < params.max_players; ++q) {
+        Player *p = &room->players[q];
+        if (!p->active) continue;
+        int bad = p->row < 0 || p->row >= n || p->col < 0 || p->col >= n ||
+                  room->obstacles[p->row * n + p->col];
+        for (int other = 0; other < q && !bad; ++other) {
+            const Player *o = &room->players[other];
+            bad = o->active && o->row == p->row && o->col == p->col;
+        }
+        if (bad) {
+            p->active = 0;
+            tokens[q][0] = '\0';
+            continue;
+        }
+        room->player_count++;
+        if (room->players[q].is_bot) room->bot_count++;
+    }
+    // No position history survives a restart: every past tick looks like now
+    for (int t = 0; t < ROOM_REWIND_TICKS; ++t) {
+        for (int q = 0; q < params.max_players; ++q) {
+            const Player *p = &room->players[q];
+            room->past_row[t * params.max_players + q] = p->active ? p->row : -1;
+            room->past_col[t * params.max_players + q] = p->active ? p->col : -1;
+        }
+    }
+    return room;
+}
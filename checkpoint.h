@@ -0,0 +1,102 @@
+/*
+ * Incremental checkpoints of a long-lived room.
+ *
+ * A checkpoint log is one append-only file. Each checkpoint appends only the
+ * obstacle chunks and player slots that changed since the previous one (the
+ * room's chunk_dirty / player_dirty flags, see game.h), followed by a commit
+ * record, so the I/O per checkpoint follows the amount of change and not the
+ * size of the world. Layout (integers in host byte order, like replay files):
+ *
+ *   CheckpointHeader                   magic, room parameters, map seed
+ *   records...                         CheckpointRecord + payload:
+ *     CHECKPOINT_CHUNK   index         uint8_t bits[CHECKPOINT_CHUNK_BYTES]
+ *     CHECKPOINT_PLAYER  slot          CheckpointPlayer
+ *     CHECKPOINT_COMMIT  sequence      CheckpointCommit
+ *
+ * Restoring rebuilds the map from the seed and replays the records in order,
+ * stopping at the last commit; a torn tail after it is ignored. Once the log
+ * grows past CHECKPOINT_COMPACT_RATIO times the size of a full image, the
+ * next checkpoint is a full image written to a new file that replaces the
+ * log with rename(), so the log never needs rewriting in place.
+ *
+ * The server collects a checkpoint under state_lock (copying only the dirty
+ * parts) and writes it after releasing the lock, so a slow disk never
+ * stalls the room.
+ */
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+#include "game.h"
+
+#define CHECKPOINT_MAGIC "ABGCKP01"
+#define CHECKPOINT_COMPACT_RATIO 4
+#define CHECKPOINT_TOKEN_LEN 16      // session tokens kept with player slots
+#define CHECKPOINT_CHUNK_BYTES TERRAIN_CHUNK_BYTES   // layout in terrain.h
+
+#define CHECKPOINT_CHUNK 'C'
+#define CHECKPOINT_PLAYER 'P'
+#define CHECKPOINT_COMMIT 'K'
+
+typedef struct {
+    char magic[8];
+    uint32_t seed;           // map seed the chunks are applied on top of
+    uint16_t grid_size;
+    uint16_t max_players;
+    int32_t max_hp;
+    int32_t damage;
+    uint32_t chunk;          // ROOM_CHUNK when written
+    uint32_t reserved;
+} CheckpointHeader;
+
+typedef struct {
+    uint32_t kind;           // CHECKPOINT_CHUNK, _PLAYER or _COMMIT
+    uint32_t index;          // chunk index, player slot or commit sequence
+} CheckpointRecord;
+
+typedef struct {
+    int32_t row, col, hp;
+    uint8_t active, is_bot;
+    char token[CHECKPOINT_TOKEN_LEN + 1];   // "" = no resumable session
+    uint8_t reserved[5];
+} CheckpointPlayer;
+
+typedef struct {
+    uint64_t version;        // room state version
+    uint64_t tick;
+    uint64_t event_seq;
+    uint32_t rng;            // spawn rand_r() state
+    uint32_t records;        // chunk and player records in this checkpoint
+    int64_t time_ms;         // Unix time of the checkpoint
+} CheckpointCommit;
+
+typedef struct CheckpointLog CheckpointLog;
+
+// Open the log at <path> for appending checkpoints. The first checkpoint
+// taken is always a full image. Returns NULL on allocation failure.
+CheckpointLog *checkpoint_open(const char *path);
+
+// Copy whatever changed in room since the last checkpoint (everything, if
+// the log is due for compaction or room is not the room last checkpointed)
+// into the log's pending buffer and clear the room's dirty flags. tokens
+// holds a session token per slot. Returns the number of records collected,
+// 0 if nothing changed. Call with the room locked, and call
+// checkpoint_flush() after every collect that returned records.
+int checkpoint_collect(CheckpointLog *log, Room *room, const char (*tokens)[CHECKPOINT_TOKEN_LEN + 1]);
+
+// Write and sync what checkpoint_collect() gathered. Needs no lock. Returns
+// the bytes written, 0 if nothing was pending, -1 on error (the next
+// checkpoint is then a full image so nothing is lost).
+long checkpoint_flush(CheckpointLog *log);
+
+// 1 if the last flush was a compaction.
+int checkpoint_compacted(const CheckpointLog *log);
+
+// Rebuild the room saved in the log at <path> and fill tokens with its
+// session tokens. Players saved off the grid, on an obstacle or on another
+// player's cell are left out. Returns NULL with err set if there is no
+// usable checkpoint.
+Room *checkpoint_restore(const char *path, char (*tokens)[CHECKPOINT_TOKEN_LEN + 1],
+                         char *err, size_t errlen);
+
+#endif
@@ -7,45 +7,660 @@
  * 2. Continuously read user input (e.g. MOVE, ATTACK, QUIT).
  * 3. Send commands to the server.
  * 4. Spawn a thread to receive and display the updated game state from the server.
+ * 5. If the connection drops, reconnect and RESUME the session so the player
+ *    keeps their slot and only receives the changes they missed.
+ *
+ * With --smooth full state frames are not printed as they arrive. They go into
+ * a jitter buffer and are rendered a little behind real time, sized from the
+ * measured arrival jitter, with player positions interpolated between the
+ * two snapshots that bracket the render time. Moves then look continuous
+ * even when the server sends updates at a low or irregular rate.
+ *
+ * With --terrain the client does not take the map from the "Grid:" section.
+ * It subscribes to terrain chunks (see terrain.h), which the server announces
+ * by content hash as they come into view, and downloads only the hashes it
+ * has not seen before. Chunks are kept in an mmap'd hash table on disk
+ * (.abg_chunks), so coming back to a known map costs no terrain downloads.
+ *
+ * With --multicast the client is a passive LAN screen: it joins the server's
+ * multicast spectator feed and renders each state it receives (see mcast.h).
+ *
+ * With --bots the client hosts bots instead of a player: it loads a decision
+ * plugin from a shared object (see bot_sdk.h) and runs <count> bots from one
+ * thread, parsing frames into structs for the plugin and sending its moves.
+ *
+ * With --churn the client instead benchmarks the server's accept path: worker
+ * threads connect, wait for the welcome, QUIT and reconnect in a tight loop,
+ * at doubling concurrency until connects/sec stops improving.
  *
  * Compile:
- *   gcc client.c -o client -pthread    
+ *   gcc client.c -o client -pthread -ldl
  *
  * Usage:
- *   ./client <SERVER_IP> <PORT>
+ *   ./client [--smooth | --terrain] <SERVER_IP> <PORT>
+ *   ./client --multicast <GROUP> <PORT> [INTERFACE_IP]
+ *   ./client --bots <PLUGIN.so> <COUNT> <SERVER_IP> <PORT>
+ *   ./client --churn <MAX_CONCURRENCY> <SERVER_IP> <PORT>
  ******************************************************************************/
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <time.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include "mcast.h"
+#include "bot_sdk.h"
+#include "terrain.h"
 
 #define BUFFER_SIZE 1024
+#define RESUME_ATTEMPTS 5
+#define RESUME_DELAY_MS 500
+#define SNAPSHOT_RING 32           /* buffered snapshots for --smooth */
+#define FRAME_MAX_GRID 128         /* larger grids are not parsed */
+#define FRAME_MAX_SLOTS 26
+#define FRAME_MAX_BYTES (FRAME_MAX_GRID * (FRAME_MAX_GRID * 2 + 1) + FRAME_MAX_SLOTS * 48 + 64)
+#define PENDING_SIZE (2 * FRAME_MAX_BYTES)   /* an unfinished frame plus what follows it */
+#define RENDER_PERIOD_MS 50
+#define MIN_PLAYOUT_MS 50
+#define MAX_PLAYOUT_MS 1000
+#define BOT_THINK_MS 100           /* how often a hosted bot may act */
+#define CHURN_LEVEL_SECONDS 2
+#define CHURN_MAX_SAMPLES 65536    /* per worker and level */
+#define CHURN_RECV_TIMEOUT_S 5
+#define CHUNK_CACHE_PATH ".abg_chunks"   /* terrain chunk cache, in the working directory */
+#define CHUNK_CACHE_MAGIC "ABGCHK01"
+#define CHUNK_CACHE_SLOTS 65536    /* about 9 MB, sparse on disk */
+#define CHUNK_CACHE_PROBES 16
+#define TERRAIN_VIEW_CELLS 32      /* side of the map window drawn by --terrain */
 
 /* Global server socket used by both main thread and receiver thread. */
-int g_serverSocket = -1;
+volatile int g_serverSocket = -1;
+
+/* Server address, session token and last state version, kept for RESUME. */
+struct sockaddr_in g_serverAddr;
+char g_sessionToken[64] = "";
+unsigned long g_lastVersion = 0;
+/* Room tick of the newest frame, sent with ATTACK for lag compensation. */
+volatile unsigned long g_lastTick = 0;
+volatile int g_haveTick = 0;
+volatile int g_quitting = 0;
+/* --smooth: frames go through the jitter buffer instead of straight out. */
+int g_smooth = 0;
+/* --terrain: the map arrives as chunks, drawn from the chunk cache. */
+int g_terrain = 0;
+
+/*---------------------------------------------------------------------------*
+ * Pick the session token and the newest state version out of server text
+ *---------------------------------------------------------------------------*/
+void trackSession(const char *text) {
+    const char *line = text;
+    while (line && *line) {
+        unsigned long version, from, tick;
+        char token[64];
+        if (sscanf(line, "Session: %63s", token) == 1) {
+            strcpy(g_sessionToken, token);
+        } else if (sscanf(line, "Tick: %lu", &tick) == 1) {
+            // With --smooth the render thread reports the tick on screen
+            if (!g_smooth) g_lastTick = tick;
+            g_haveTick = 1;
+        } else if (sscanf(line, "Version: %lu", &version) == 1 ||
+                   sscanf(line, "Delta: v%lu -> v%lu", &from, &version) == 2) {
+            g_lastVersion = version;
+        }
+        line = strchr(line, '\n');
+        if (line) line++;
+    }
+}
+
+/*---------------------------------------------------------------------------*
+ * Reconnect after a dropped connection and resume the session.
+ * Returns the new socket, or -1 if the session could not be resumed.
+ *---------------------------------------------------------------------------*/
+int resumeSession(void) {
+    if (g_sessionToken[0] == '\0') return -1;
+    for (int attempt = 1; attempt <= RESUME_ATTEMPTS && !g_quitting; ++attempt) {
+        usleep(RESUME_DELAY_MS * 1000);
+        printf("Connection lost, resuming session (attempt %d/%d)...\n", attempt, RESUME_ATTEMPTS);
+        int sock = socket(AF_INET, SOCK_STREAM, 0);
+        if (sock < 0) continue;
+        if (connect(sock, (struct sockaddr *)&g_serverAddr, sizeof(g_serverAddr)) == -1) {
+            close(sock);
+            continue;
+        }
+        char command[128];
+        snprintf(command, sizeof(command), "RESUME %s %lu\n", g_sessionToken, g_lastVersion);
+        if (send(sock, command, strlen(command), 0) == -1) {
+            close(sock);
+            continue;
+        }
+        return sock;
+    }
+    return -1;
+}
+
+/*---------------------------------------------------------------------------*
+ * Parsing full state frames (--smooth and --bots)
+ *---------------------------------------------------------------------------*/
+typedef struct {
+    double arrivalMs;
+    unsigned long version, tick;
+    int haveTick;
+    int gridSize;
+    char cells[FRAME_MAX_GRID * FRAME_MAX_GRID];   /* '.' or 'X' */
+    int active[FRAME_MAX_SLOTS], row[FRAME_MAX_SLOTS], col[FRAME_MAX_SLOTS], hp[FRAME_MAX_SLOTS];
+} Snapshot;
+
+/* Called for each complete frame (isFrame = 1) or run of other text. */
+typedef void (*BlockHandler)(char *block, int isFrame, void *ctx);
+
+double nowMs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+/* Parse one "Version: ... Grid: ... Players: ..." frame. Returns 0 on success. */
+int parseSnapshot(const char *text, Snapshot *snap) {
+    memset(snap, 0, sizeof(*snap));
+    if (sscanf(text, "Version: %lu", &snap->version) != 1) return -1;
+    const char *tick = strstr(text, "\nTick: ");
+    snap->haveTick = tick && sscanf(tick, "\nTick: %lu", &snap->tick) == 1;
+    const char *grid = strstr(text, "Grid:\n");
+    const char *players = strstr(text, "Players:\n");
+    if (!grid || !players || players < grid) return -1;
+    int r = 0;
+    for (const char *line = grid + 6; line < players && r < FRAME_MAX_GRID; ++r) {
+        int c = 0;
+        for (; *line != '\n' && line < players; line += 2) {
+            if (c >= FRAME_MAX_GRID) return -1;
+            snap->cells[r * FRAME_MAX_GRID + c++] = *line == 'X' ? 'X' : '.';
+        }
+        if (r == 0) snap->gridSize = c;
+        line++;
+    }
+    if (snap->gridSize == 0 || r != snap->gridSize) return -1;
+    for (const char *line = players + 9; *line; ) {
+        char symbol;
+        int hp, row, col;
+        if (sscanf(line, "%c: HP=%d at (%d,%d)", &symbol, &hp, &row, &col) == 4 &&
+            symbol >= 'A' && symbol < 'A' + FRAME_MAX_SLOTS) {
+            int p = symbol - 'A';
+            snap->active[p] = 1;
+            snap->hp[p] = hp;
+            snap->row[p] = row;
+            snap->col[p] = col;
+        }
+        line = strchr(line, '\n');
+        if (!line) break;
+        line++;
+    }
+    // Player X is drawn like an obstacle; players stand on free cells
+    for (int p = 0; p < FRAME_MAX_SLOTS; ++p) {
+        if (snap->active[p] && snap->row[p] >= 0 && snap->row[p] < snap->gridSize &&
+            snap->col[p] >= 0 && snap->col[p] < snap->gridSize) {
+            snap->cells[snap->row[p] * FRAME_MAX_GRID + snap->col[p]] = '.';
+        }
+    }
+    return 0;
+}
+
+/* Append received text to pending (a string of capacity cap) and hand every
+ * complete block to handler: state frames one by one, other text as it
+ * comes. A trailing frame without its Players section is kept until the
+ * rest arrives. */
+void splitFrames(char *pending, size_t cap, const char *text, BlockHandler handler, void *ctx) {
+    size_t used = strlen(pending);
+    if (used + strlen(text) >= cap) used = 0;   /* resynchronize */
+    strcpy(pending + used, text);
+    char *cursor = pending;
+    while (*cursor) {
+        char *start = strstr(cursor, "Version: ");
+        if (start != cursor) {
+            /* Plain text before the next frame */
+            size_t plain = start ? (size_t)(start - cursor) : strlen(cursor);
+            char saved = cursor[plain];
+            cursor[plain] = '\0';
+            handler(cursor, 0, ctx);
+            cursor[plain] = saved;
+            cursor += plain;
+            continue;
+        }
+        // A frame runs until the next frame or chat batch
+        char *next = strstr(start + 9, "Version: ");
+        char *chat = strstr(start, "\nChat: ");
+        if (chat && (!next || chat + 1 < next)) next = chat + 1;
+        int complete = next != NULL ||
+                       (strstr(start, "Players:\n") && start[strlen(start) - 1] == '\n') ||
+                       (strstr(start, "Grid:\n") == NULL && start[strlen(start) - 1] == '\n');
+        if (!complete) break;
+        size_t length = next ? (size_t)(next - start) : strlen(start);
+        char saved = start[length];
+        start[length] = '\0';
+        handler(start, 1, ctx);
+        start[length] = saved;
+        cursor = start + length;
+    }
+    memmove(pending, cursor, strlen(cursor) + 1);
+}
+
+/*---------------------------------------------------------------------------*
+ * Jitter buffer and interpolation for --smooth
+ *---------------------------------------------------------------------------*/
+Snapshot g_snapshots[SNAPSHOT_RING];
+int g_snapCount = 0, g_snapNext = 0;
+double g_lastArrival = 0, g_meanInterval = 0, g_jitter = 0;
+pthread_mutex_t g_snapLock = PTHREAD_MUTEX_INITIALIZER;
+char g_pending[PENDING_SIZE];   /* received text not yet parsed */
+
+
+/* Add a snapshot and update the inter-arrival statistics (RFC 3550 style
+ * jitter). Gaps longer than MAX_PLAYOUT_MS are idle periods, not jitter. */
+void pushSnapshot(const Snapshot *snap) {
+    pthread_mutex_lock(&g_snapLock);
+    double interval = snap->arrivalMs - g_lastArrival;
+    if (g_snapCount > 0 && interval < MAX_PLAYOUT_MS) {
+        if (g_meanInterval == 0) g_meanInterval = interval;
+        double deviation = interval > g_meanInterval ? interval - g_meanInterval : g_meanInterval - interval;
+        g_meanInterval += (interval - g_meanInterval) / 8;
+        g_jitter += (deviation - g_jitter) / 16;
+    }
+    g_lastArrival = snap->arrivalMs;
+    g_snapshots[g_snapNext] = *snap;
+    g_snapNext = (g_snapNext + 1) % SNAPSHOT_RING;
+    if (g_snapCount < SNAPSHOT_RING) g_snapCount++;
+    pthread_mutex_unlock(&g_snapLock);
+}
+
+/* Render delay: one typical interval so two snapshots bracket the render
+ * time, plus a margin of three times the measured jitter. */
+double playoutDelay(void) {
+    double delay = g_meanInterval + 3 * g_jitter;
+    if (delay < MIN_PLAYOUT_MS) delay = MIN_PLAYOUT_MS;
+    if (delay > MAX_PLAYOUT_MS) delay = MAX_PLAYOUT_MS;
+    return delay;
+}
+
+/* Print the state as of (now - playout delay), interpolating positions
+ * between the bracketing snapshots. Only redraws when the picture changes. */
+void *renderThread(void *arg) {
+    (void) arg;
+    static char frame[FRAME_MAX_BYTES];
+    static char shown[sizeof(frame)];
+    while (1) {
+        usleep(RENDER_PERIOD_MS * 1000);
+        pthread_mutex_lock(&g_snapLock);
+        if (g_snapCount == 0) {
+            pthread_mutex_unlock(&g_snapLock);
+            continue;
+        }
+        double renderAt = nowMs() - playoutDelay();
+        int oldest = (g_snapNext - g_snapCount + SNAPSHOT_RING) % SNAPSHOT_RING;
+        const Snapshot *from = &g_snapshots[oldest], *to = NULL;
+        for (int i = 1; i < g_snapCount; ++i) {
+            const Snapshot *s = &g_snapshots[(oldest + i) % SNAPSHOT_RING];
+            if (s->arrivalMs > renderAt) {
+                to = s;
+                break;
+            }
+            from = s;
+        }
+        double alpha = 0;
+        if (to && to->gridSize == from->gridSize && renderAt > from->arrivalMs) {
+            alpha = (renderAt - from->arrivalMs) / (to->arrivalMs - from->arrivalMs);
+        }
+        int row[FRAME_MAX_SLOTS], col[FRAME_MAX_SLOTS];
+        for (int p = 0; p < FRAME_MAX_SLOTS; ++p) {
+            row[p] = from->row[p];
+            col[p] = from->col[p];
+            if (alpha > 0 && from->active[p] && to->active[p]) {
+                row[p] = (int)(from->row[p] + (to->row[p] - from->row[p]) * alpha + 0.5);
+                col[p] = (int)(from->col[p] + (to->col[p] - from->col[p]) * alpha + 0.5);
+            }
+        }
+        int n = from->gridSize;
+        size_t len = snprintf(frame, sizeof(frame), "Version: %lu\n", from->version);
+        if (from->haveTick) {
+            len += snprintf(frame + len, sizeof(frame) - len, "Tick: %lu\n", from->tick);
+            // ATTACK is judged against what is on screen, not the newest frame
+            g_lastTick = from->tick;
+        }
+        len += snprintf(frame + len, sizeof(frame) - len, "Grid:\n");
+        for (int r = 0; r < n; ++r) {
+            for (int c = 0; c < n; ++c) {
+                char symbol = from->cells[r * FRAME_MAX_GRID + c];
+                for (int p = 0; p < FRAME_MAX_SLOTS; ++p) {
+                    if (from->active[p] && row[p] == r && col[p] == c) {
+                        symbol = 'A' + p;
+                        break;
+                    }
+                }
+                frame[len++] = symbol;
+                frame[len++] = ' ';
+            }
+            frame[len++] = '\n';
+        }
+        len += snprintf(frame + len, sizeof(frame) - len, "Players:\n");
+        for (int p = 0; p < FRAME_MAX_SLOTS; ++p) {
+            if (from->active[p]) {
+                len += snprintf(frame + len, sizeof(frame) - len, "%c: HP=%d at (%d,%d)\n",
+                                'A' + p, from->hp[p], row[p], col[p]);
+            }
+        }
+        pthread_mutex_unlock(&g_snapLock);
+        // Version and tick lines alone changing are not worth a redraw
+        const char *body = strstr(frame, "Grid:");
+        const char *shownBody = strstr(shown, "Grid:");
+        if (!shownBody || strcmp(body, shownBody) != 0) {
+            printf("\n%s\n", frame);
+            fflush(stdout);
+            strcpy(shown, frame);
+        }
+    }
+    return NULL;
+}
+
+/* Full state frames go to the jitter buffer; everything else (messages,
+ * channel or delta frames) is printed immediately. */
+void smoothBlock(char *block, int isFrame, void *ctx) {
+    (void) ctx;
+    Snapshot snap;
+    if (isFrame && parseSnapshot(block, &snap) == 0) {
+        snap.arrivalMs = nowMs();
+        pushSnapshot(&snap);
+        return;
+    }
+    printf("\n%s\n", block);
+    fflush(stdout);
+}
+
+/*---------------------------------------------------------------------------*
+ * Terrain chunks and the on-disk chunk cache (--terrain)
+ *---------------------------------------------------------------------------*/
+typedef struct {
+    char magic[8];
+    uint32_t slots;
+    uint32_t reserved;
+} ChunkCacheHeader;
+
+typedef struct {
+    uint64_t hash;             /* 0 = empty slot */
+    uint8_t bits[TERRAIN_CHUNK_BYTES];
+} ChunkCacheEntry;
+
+ChunkCacheEntry *g_cache = NULL;
+uint32_t g_cacheSlots = 0;
+
+int g_gridSize = 0, g_perSide = 0, g_self = -1;
+uint64_t g_chunkHash[TERRAIN_MAX_CHUNKS];  /* announced hash per chunk, 0 = unknown */
+int g_wanted[TERRAIN_MAX_CHUNKS], g_wantedCount = 0, g_inFlight = 0;
+int g_announced = 0, g_fromCache = 0, g_downloaded = 0, g_reportDue = 0;
+int g_active[FRAME_MAX_SLOTS], g_row[FRAME_MAX_SLOTS], g_col[FRAME_MAX_SLOTS], g_hp[FRAME_MAX_SLOTS];
+unsigned long g_frameVersion = 0, g_frameTick = 0;
+enum { SECTION_NONE, SECTION_POSITIONS, SECTION_HP } g_section = SECTION_NONE;
+
+/* Map the cache file, creating or resetting it when it is missing or not a
+ * cache. The table lives in a sparse file, so untouched slots cost no disk.
+ * Returns 0 on success. */
+int openChunkCache(const char *path) {
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return -1;
+    size_t size = sizeof(ChunkCacheHeader) + (size_t)CHUNK_CACHE_SLOTS * sizeof(ChunkCacheEntry);
+    ChunkCacheHeader header;
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header.magic, CHUNK_CACHE_MAGIC, 8) != 0 || header.slots != CHUNK_CACHE_SLOTS) {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, CHUNK_CACHE_MAGIC, 8);
+        header.slots = CHUNK_CACHE_SLOTS;
+        if (ftruncate(fd, 0) < 0 || ftruncate(fd, size) < 0 ||
+            pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
+            close(fd);
+            return -1;
+        }
+    }
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+    g_cache = (ChunkCacheEntry *)((char *)map + sizeof(ChunkCacheHeader));
+    g_cacheSlots = CHUNK_CACHE_SLOTS;
+    return 0;
+}
+
+/* Open-addressed lookup, probing CHUNK_CACHE_PROBES slots from the home slot. */
+const uint8_t *cacheLookup(uint64_t hash) {
+    if (!g_cache) return NULL;
+    for (uint32_t i = 0; i < CHUNK_CACHE_PROBES; ++i) {
+        ChunkCacheEntry *e = &g_cache[(hash + i) % g_cacheSlots];
+        if (e->hash == hash) return e->bits;
+        if (e->hash == 0) return NULL;
+    }
+    return NULL;
+}
+
+/* Store a chunk; when every probed slot is taken the home slot is evicted. */
+void cacheStore(uint64_t hash, const uint8_t *bits) {
+    if (!g_cache) return;
+    ChunkCacheEntry *slot = &g_cache[hash % g_cacheSlots];
+    for (uint32_t i = 0; i < CHUNK_CACHE_PROBES; ++i) {
+        ChunkCacheEntry *e = &g_cache[(hash + i) % g_cacheSlots];
+        if (e->hash == 0 || e->hash == hash) {
+            slot = e;
+            break;
+        }
+    }
+    memcpy(slot->bits, bits, TERRAIN_CHUNK_BYTES);
+    slot->hash = hash;
+}
+
+/* Ask for the next batch of chunks we have no copy of. */
+void requestChunks(void) {
+    if (g_inFlight > 0 || g_wantedCount == 0) return;
+    char command[32 + TERRAIN_FETCH_MAX * 8];
+    int len = snprintf(command, sizeof(command), "CHUNK");
+    int batch = g_wantedCount < TERRAIN_FETCH_MAX ? g_wantedCount : TERRAIN_FETCH_MAX;
+    for (int i = 0; i < batch; ++i) {
+        len += snprintf(command + len, sizeof(command) - len, " %d", g_wanted[i]);
+    }
+    command[len++] = '\n';
+    memmove(g_wanted, g_wanted + batch, (g_wantedCount - batch) * sizeof(int));
+    g_wantedCount -= batch;
+    g_inFlight = batch;
+    send(g_serverSocket, command, len, 0);
+}
+
+/* Draw the TERRAIN_VIEW_CELLS square around our player from cached chunks;
+ * cells of chunks that have not arrived yet show as '?'. */
+void renderTerrain(void) {
+    static char frame[TERRAIN_VIEW_CELLS * (TERRAIN_VIEW_CELLS * 2 + 1) + FRAME_MAX_SLOTS * 48 + 128];
+    static char shown[sizeof(frame)];
+    if (g_gridSize == 0) return;
+    int size = g_gridSize < TERRAIN_VIEW_CELLS ? g_gridSize : TERRAIN_VIEW_CELLS;
+    int top = 0, left = 0;
+    if (g_self >= 0 && g_active[g_self]) {
+        top = g_row[g_self] - size / 2;
+        left = g_col[g_self] - size / 2;
+        if (top > g_gridSize - size) top = g_gridSize - size;
+        if (left > g_gridSize - size) left = g_gridSize - size;
+        if (top < 0) top = 0;
+        if (left < 0) left = 0;
+    }
+    size_t len = snprintf(frame, sizeof(frame), "Version: %lu\nTick: %lu\nGrid: rows %d-%d, columns %d-%d\n",
+                          g_frameVersion, g_frameTick, top, top + size - 1, left, left + size - 1);
+    size_t body = len;
+    for (int r = top; r < top + size; ++r) {
+        for (int c = left; c < left + size; ++c) {
+            int chunk = (r / TERRAIN_CHUNK) * g_perSide + c / TERRAIN_CHUNK;
+            const uint8_t *bits = g_chunkHash[chunk] ? cacheLookup(g_chunkHash[chunk]) : NULL;
+            int bit = (r % TERRAIN_CHUNK) * TERRAIN_CHUNK + c % TERRAIN_CHUNK;
+            char symbol = !bits ? '?' : (bits[bit / 8] >> (bit % 8)) & 1 ? 'X' : '.';
+            for (int p = 0; p < FRAME_MAX_SLOTS; ++p) {
+                if (g_active[p] && g_row[p] == r && g_col[p] == c) {
+                    symbol = 'A' + p;
+                    break;
+                }
+            }
+            frame[len++] = symbol;
+            frame[len++] = ' ';
+        }
+        frame[len++] = '\n';
+    }
+    len += snprintf(frame + len, sizeof(frame) - len, "Players:\n");
+    for (int p = 0; p < FRAME_MAX_SLOTS; ++p) {
+        if (g_active[p]) {
+            len += snprintf(frame + len, sizeof(frame) - len, "%c: HP=%d at (%d,%d)\n",
+                            'A' + p, g_hp[p], g_row[p], g_col[p]);
+        }
+    }
+    // Version and tick lines alone changing are not worth a redraw
+    if (strcmp(frame + body, shown) != 0) {
+        printf("\n%s\n", frame);
+        fflush(stdout);
+        strcpy(shown, frame + body);
+    }
+}
+
+/* Handle one line from the server. Returns 1 if it changed the picture. */
+int terrainLine(const char *line) {
+    char symbol;
+    int index, a, b;
+    unsigned long long hash;
+    char hex[2 * TERRAIN_CHUNK_BYTES + 1];
+    if (sscanf(line, "Version: %lu", &g_frameVersion) == 1) {
+        g_section = SECTION_NONE;
+        return 1;
+    }
+    if (sscanf(line, "Tick: %lu", &g_frameTick) == 1) return 0;
+    if (sscanf(line, "Terrain: %d %d", &a, &b) == 2 && a > 0 && a <= 1024) {
+        g_gridSize = a;
+        g_perSide = (a + TERRAIN_CHUNK - 1) / TERRAIN_CHUNK;
+        memset(g_chunkHash, 0, sizeof(g_chunkHash));
+        g_wantedCount = g_inFlight = 0;
+        return 1;
+    }
+    if (sscanf(line, "Chunk: %d %llx", &index, &hash) == 2 && index >= 0 && index < g_perSide * g_perSide) {
+        g_chunkHash[index] = hash;
+        g_announced++;
+        g_reportDue = 1;
+        if (cacheLookup(hash)) {
+            g_fromCache++;
+        } else {
+            g_wanted[g_wantedCount++] = index;
+        }
+        return 1;
+    }
+    if (sscanf(line, "ChunkData: %d %llx %256s", &index, &hash, hex) == 3) {
+        uint8_t bits[TERRAIN_CHUNK_BYTES];
+        int ok = strlen(hex) == sizeof(hex) - 1;
+        for (int i = 0; ok && i < TERRAIN_CHUNK_BYTES; ++i) {
+            ok = sscanf(hex + 2 * i, "%2hhx", &bits[i]) == 1;
+        }
+        // Content addressing: never cache a chunk that does not match its name
+        if (ok && terrain_chunk_hash(bits) == hash) {
+            cacheStore(hash, bits);
+            g_downloaded++;
+        }
+        if (g_inFlight > 0) g_inFlight--;
+        return 1;
+    }
+    if (strcmp(line, "Positions:") == 0) {
+        g_section = SECTION_POSITIONS;
+        memset(g_active, 0, sizeof(g_active));
+        return 1;
+    }
+    if (strcmp(line, "HP:") == 0) {
+        g_section = SECTION_HP;
+        return 1;
+    }
+    if (g_section == SECTION_POSITIONS && sscanf(line, "%c: (%d,%d)", &symbol, &a, &b) == 3 &&
+        symbol >= 'A' && symbol < 'A' + FRAME_MAX_SLOTS) {
+        g_active[symbol - 'A'] = 1;
+        g_row[symbol - 'A'] = a;
+        g_col[symbol - 'A'] = b;
+        return 1;
+    }
+    if (g_section == SECTION_HP && sscanf(line, "%c: %d", &symbol, &a) == 2 &&
+        symbol >= 'A' && symbol < 'A' + FRAME_MAX_SLOTS) {
+        g_hp[symbol - 'A'] = a;
+        return 1;
+    }
+    g_section = SECTION_NONE;
+    const char *who = strstr(line, "layer ");
+    if (who && (strstr(line, "You are player ") || strstr(line, "Resumed as player "))) {
+        g_self = who[6] - 'A';
+    }
+    if (strncmp(line, "Usage: CHUNK", 12) == 0) g_inFlight = 0;
+    if (*line) printf("%s\n", line);
+    return 0;
+}
+
+/* Feed received text through terrainLine() a complete line at a time, then
+ * fetch missing chunks and redraw. */
+void terrainText(const char *text) {
+    size_t used = strlen(g_pending);
+    if (used + strlen(text) >= sizeof(g_pending)) used = 0;   /* resynchronize */
+    strcpy(g_pending + used, text);
+    int changed = 0;
+    char *line = g_pending, *newline;
+    while ((newline = strchr(line, '\n'))) {
+        *newline = '\0';
+        changed |= terrainLine(line);
+        line = newline + 1;
+    }
+    memmove(g_pending, line, strlen(line) + 1);
+    requestChunks();
+    if (g_reportDue && g_inFlight == 0 && g_wantedCount == 0) {
+        printf("\nTerrain: %d chunks announced, %d from cache, %d downloaded\n",
+               g_announced, g_fromCache, g_downloaded);
+        g_reportDue = 0;
+    }
+    if (changed) renderTerrain();
+}
 
 /*---------------------------------------------------------------------------*
  * Thread to continuously receive updates (ASCII grid) from the server
  *---------------------------------------------------------------------------*/
 void *receiverThread(void *arg) {
-    int *sock = (int *) arg;
+    (void) arg;
     char buffer[BUFFER_SIZE];
 
     while (1) {
         memset(buffer, 0, sizeof(buffer));
-        ssize_t bytesRead = recv(*sock, buffer, sizeof(buffer), 0);
+        ssize_t bytesRead = recv(g_serverSocket, buffer, sizeof(buffer) - 1, 0);
         if (bytesRead <= 0) {
+            int sock = g_quitting ? -1 : resumeSession();
+            if (sock >= 0) {
+                close(g_serverSocket);
+                g_serverSocket = sock;
+                continue;
+            }
             printf("Disconnected from server.\n");
             break;
         }
 
         // Print the game state or server message
+        trackSession(buffer);
+        if (strstr(buffer, "Resume failed")) {
+            printf("\n%s\n", buffer);
+            break;
+        }
+        if (g_smooth) {
+            splitFrames(g_pending, sizeof(g_pending), buffer, smoothBlock, NULL);
+            continue;
+        }
+        if (g_terrain) {
+            terrainText(buffer);
+            continue;
+        }
         printf("\n%s\n", buffer);
         fflush(stdout);
     }
@@ -55,12 +670,409 @@ void *receiverThread(void *arg) {
     return NULL;
 }
 
+/*---------------------------------------------------------------------------*
+ * Multicast spectator feed: render one state the same way the server does
+ *---------------------------------------------------------------------------*/
+void renderMcastState(unsigned long version, int grid, const unsigned char *map,
+                      const McastPlayer *players, int slots) {
+    printf("\nVersion: %lu\nGrid:\n", version);
+    for (int r = 0; r < grid; ++r) {
+        for (int c = 0; c < grid; ++c) {
+            int cell = r * grid + c;
+            char symbol = (map[cell / 8] >> (cell % 8)) & 1 ? 'X' : '.';
+            for (int p = 0; p < slots; ++p) {
+                if (players[p].active && players[p].row == r && players[p].col == c) {
+                    symbol = 'A' + p;
+                    break;
+                }
+            }
+            printf("%c ", symbol);
+        }
+        printf("\n");
+    }
+    printf("Players:\n");
+    for (int p = 0; p < slots; ++p) {
+        if (players[p].active) {
+            printf("%c: HP=%d at (%d,%d)\n", 'A' + p, players[p].hp, players[p].row, players[p].col);
+        }
+    }
+    fflush(stdout);
+}
+
+/*---------------------------------------------------------------------------*
+ * Join the multicast group and render every datagram. After a sequence gap
+ * deltas are ignored until the next keyframe resynchronizes the view.
+ *---------------------------------------------------------------------------*/
+int runMulticastReceiver(const char *group, int port, const char *iface) {
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        perror("Failed to create socket!\n");
+        return -1;
+    }
+    int reuse = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_port = htons(port);
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(sock, (struct sockaddr *)&local, sizeof(local)) == -1) {
+        perror("Failed to bind multicast port!\n");
+        return -1;
+    }
+    struct ip_mreq membership;
+    membership.imr_interface.s_addr = htonl(INADDR_ANY);
+    if (inet_pton(AF_INET, group, &membership.imr_multiaddr) != 1 ||
+        (iface && inet_pton(AF_INET, iface, &membership.imr_interface) != 1) ||
+        setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) == -1) {
+        perror("Failed to join multicast group!\n");
+        return -1;
+    }
+    printf("Listening to multicast feed %s:%d\n", group, port);
+
+    static unsigned char datagram[MCAST_MAX_DATAGRAM];
+    static McastPlayer players[MCAST_MAX_SLOTS];
+    static unsigned char map[MCAST_MAX_DATAGRAM];
+    int synced = 0, grid = 0, slots = 0;
+    uint32_t expectSeq = 0;
+    unsigned long lost = 0, shownVersion = 0;
+    int shown = 0;
+    while (1) {
+        ssize_t n = recv(sock, datagram, sizeof(datagram), 0);
+        if (n < (ssize_t)sizeof(McastHeader)) continue;
+        McastHeader h;
+        memcpy(&h, datagram, sizeof(h));
+        if (memcmp(h.magic, MCAST_MAGIC, sizeof(h.magic)) != 0) continue;
+        size_t mapBytes = ((size_t)h.grid_size * h.grid_size + 7) / 8;
+        size_t need = sizeof(h) + h.count * sizeof(McastPlayer) +
+                      (h.kind == MCAST_KEYFRAME ? mapBytes : 0);
+        if ((size_t)n < need) continue;
+        if (synced && h.seq != expectSeq) {
+            // Lost or reordered datagrams: wait for a keyframe
+            lost += h.seq - expectSeq;
+            printf("Feed gap (%lu datagrams lost so far), waiting for a keyframe...\n", lost);
+            synced = 0;
+            shown = 0;
+        }
+        expectSeq = h.seq + 1;
+        if (h.kind == MCAST_KEYFRAME) {
+            grid = h.grid_size;
+            slots = h.max_players;
+            memset(players, 0, sizeof(players));
+            memcpy(map, datagram + need - mapBytes, mapBytes);
+            synced = 1;
+        } else if (!synced || h.grid_size != grid || h.max_players != slots) {
+            continue;
+        }
+        for (int i = 0; i < h.count; ++i) {
+            McastPlayer p;
+            memcpy(&p, datagram + sizeof(h) + i * sizeof(p), sizeof(p));
+            if (p.slot < slots) players[p.slot] = p;
+        }
+        // Periodic keyframes repeat a state already on screen
+        if (shown && h.version == shownVersion) continue;
+        renderMcastState(h.version, grid, map, players, slots);
+        shown = 1;
+        shownVersion = h.version;
+    }
+    return 0;
+}
+
+/*---------------------------------------------------------------------------*
+ * Bot host (--bots): plugin-driven bots sharing one epoll loop
+ *---------------------------------------------------------------------------*/
+typedef struct {
+    int sock;
+    int slot;                  /* -1 until the welcome names our player */
+    int haveState;
+    double lastActMs;
+    void *instance;
+    Snapshot *state;           /* newest full frame */
+    char pending[PENDING_SIZE];
+} HostedBot;
+
+static const BotPlugin *g_plugin;
+
+void botBlock(char *block, int isFrame, void *ctx) {
+    HostedBot *bot = ctx;
+    char symbol;
+    const char *welcome = strstr(block, "You are player ");
+    if (!isFrame && welcome && sscanf(welcome, "You are player %c", &symbol) == 1) {
+        bot->slot = symbol - 'A';
+    } else if (isFrame && parseSnapshot(block, bot->state) == 0) {
+        bot->haveState = 1;
+    }
+}
+
+/* Hand the newest state to the plugin and send the command it picks. */
+void botThink(HostedBot *bot) {
+    static const char *directions[] = { "UP", "DOWN", "LEFT", "RIGHT" };
+    const Snapshot *snap = bot->state;
+    BotState state;
+    memset(&state, 0, sizeof(state));
+    state.version = snap->version;
+    state.tick = snap->tick;
+    state.grid_size = snap->gridSize;
+    state.stride = FRAME_MAX_GRID;
+    state.cells = snap->cells;
+    state.self = bot->slot;
+    for (int p = 0; p < BOT_MAX_SLOTS; ++p) {
+        state.players[p].active = snap->active[p];
+        state.players[p].row = snap->row[p];
+        state.players[p].col = snap->col[p];
+        state.players[p].hp = snap->hp[p];
+    }
+    BotCommand command = { BOT_MOVE, BOT_UP };
+    if (!g_plugin->on_frame(bot->instance, &state, &command)) return;
+    char text[64];
+    if (command.type == BOT_ATTACK) {
+        snprintf(text, sizeof(text), "ATTACK %lu", snap->tick);
+    } else if (command.dir >= BOT_UP && command.dir <= BOT_RIGHT) {
+        snprintf(text, sizeof(text), "MOVE %s", directions[command.dir]);
+    } else {
+        return;
+    }
+    // Commands are tiny; if the socket is backed up, skip this one
+    send(bot->sock, text, strlen(text), MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+int runBotHost(const char *pluginPath, int count) {
+    void *library = dlopen(pluginPath, RTLD_NOW | RTLD_LOCAL);
+    if (!library) {
+        fprintf(stderr, "Failed to load %s: %s\n", pluginPath, dlerror());
+        return 1;
+    }
+    const BotPlugin *(*entry)(void) = (const BotPlugin *(*)(void)) dlsym(library, BOT_PLUGIN_SYMBOL);
+    g_plugin = entry ? entry() : NULL;
+    if (!g_plugin || g_plugin->abi != BOT_SDK_ABI || !g_plugin->on_frame) {
+        fprintf(stderr, "%s is not a bot plugin for SDK ABI %d\n", pluginPath, BOT_SDK_ABI);
+        return 1;
+    }
+    int epfd = epoll_create1(0);
+    HostedBot *bots = calloc(count, sizeof(HostedBot));
+    if (epfd < 0 || !bots) {
+        perror("Failed to set up bot host");
+        return 1;
+    }
+
+    int live = 0;
+    for (int i = 0; i < count; ++i) {
+        HostedBot *bot = &bots[i];
+        bot->sock = socket(AF_INET, SOCK_STREAM, 0);
+        bot->state = malloc(sizeof(Snapshot));
+        if (bot->sock < 0 || !bot->state ||
+            connect(bot->sock, (struct sockaddr *)&g_serverAddr, sizeof(g_serverAddr)) == -1) {
+            perror("Bot failed to connect");
+            if (bot->sock >= 0) close(bot->sock);
+            bot->sock = -1;
+            continue;
+        }
+        fcntl(bot->sock, F_SETFL, fcntl(bot->sock, F_GETFL) | O_NONBLOCK);
+        bot->slot = -1;
+        bot->instance = g_plugin->create ? g_plugin->create(i) : NULL;
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = bot };
+        epoll_ctl(epfd, EPOLL_CTL_ADD, bot->sock, &ev);
+        live++;
+    }
+    printf("Hosting %d %s bot(s)\n", live, g_plugin->name ? g_plugin->name : "plugin");
+    fflush(stdout);
+
+    struct epoll_event events[64];
+    char buffer[BUFFER_SIZE];
+    while (live > 0) {
+        int ready = epoll_wait(epfd, events, 64, BOT_THINK_MS / 4);
+        for (int e = 0; e < ready; ++e) {
+            HostedBot *bot = events[e].data.ptr;
+            ssize_t n;
+            while ((n = recv(bot->sock, buffer, sizeof(buffer) - 1, 0)) > 0) {
+                buffer[n] = '\0';
+                splitFrames(bot->pending, sizeof(bot->pending), buffer, botBlock, bot);
+            }
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+                // Server full, killed, or the room ended
+                printf("Bot %c disconnected.\n", bot->slot >= 0 ? 'A' + bot->slot : '?');
+                epoll_ctl(epfd, EPOLL_CTL_DEL, bot->sock, NULL);
+                close(bot->sock);
+                bot->sock = -1;
+                if (g_plugin->destroy) g_plugin->destroy(bot->instance);
+                live--;
+            }
+        }
+        double now = nowMs();
+        for (int i = 0; i < count; ++i) {
+            HostedBot *bot = &bots[i];
+            if (bot->sock < 0 || !bot->haveState || bot->slot < 0 || now - bot->lastActMs < BOT_THINK_MS) continue;
+            bot->lastActMs = now;
+            botThink(bot);
+        }
+    }
+    printf("All bots disconnected.\n");
+    return 0;
+}
+
+/*---------------------------------------------------------------------------*
+ * Connection-churn benchmark
+ *---------------------------------------------------------------------------*/
+typedef struct {
+    volatile int *stop;
+    double *samples;           /* time-to-welcome in ms */
+    int sampleCount;
+    long welcomed, refused, failed;
+} ChurnWorker;
+
+/* Connect, wait for the welcome (or refusal), QUIT and wait for the close. */
+void *churnWorker(void *arg) {
+    ChurnWorker *w = arg;
+    char buffer[BUFFER_SIZE];
+    while (!*w->stop) {
+        double start = nowMs();
+        int sock = socket(AF_INET, SOCK_STREAM, 0);
+        if (sock < 0 || connect(sock, (struct sockaddr *)&g_serverAddr, sizeof(g_serverAddr)) == -1) {
+            if (sock >= 0) close(sock);
+            w->failed++;
+            usleep(1000);
+            continue;
+        }
+        // A stalled server counts as a failure instead of hanging the run
+        struct timeval timeout = { CHURN_RECV_TIMEOUT_S, 0 };
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        size_t used = 0;
+        int welcomed = 0, refused = 0;
+        while (!welcomed && !refused) {
+            if (used >= sizeof(buffer) - 1) used = 0;
+            ssize_t n = recv(sock, buffer + used, sizeof(buffer) - 1 - used, 0);
+            if (n <= 0) break;
+            used += n;
+            buffer[used] = '\0';
+            welcomed = strstr(buffer, "Welcome") != NULL;
+            refused = strstr(buffer, "Server full") != NULL;
+        }
+        if (welcomed) {
+            if (w->sampleCount < CHURN_MAX_SAMPLES) w->samples[w->sampleCount++] = nowMs() - start;
+            w->welcomed++;
+            send(sock, "QUIT\n", 5, 0);
+            shutdown(sock, SHUT_WR);
+            while (recv(sock, buffer, sizeof(buffer), 0) > 0) {
+            }
+        } else if (refused) {
+            w->refused++;
+        } else {
+            w->failed++;
+        }
+        close(sock);
+    }
+    return NULL;
+}
+
+int compareDouble(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Run one concurrency level; returns connects/sec (welcomed + refused). */
+double churnLevel(int concurrency) {
+    volatile int stop = 0;
+    ChurnWorker *workers = calloc(concurrency, sizeof(ChurnWorker));
+    pthread_t *threads = calloc(concurrency, sizeof(pthread_t));
+    int started = 0;
+    for (int i = 0; i < concurrency; ++i) {
+        workers[i].stop = &stop;
+        workers[i].samples = malloc(CHURN_MAX_SAMPLES * sizeof(double));
+        if (!workers[i].samples || pthread_create(&threads[i], NULL, churnWorker, &workers[i]) != 0) break;
+        started++;
+    }
+    double begin = nowMs();
+    sleep(CHURN_LEVEL_SECONDS);
+    stop = 1;
+    for (int i = 0; i < started; ++i) pthread_join(threads[i], NULL);
+    double seconds = (nowMs() - begin) / 1000.0;
+
+    long welcomed = 0, refused = 0, failed = 0;
+    int total = 0;
+    for (int i = 0; i < started; ++i) {
+        welcomed += workers[i].welcomed;
+        refused += workers[i].refused;
+        failed += workers[i].failed;
+        total += workers[i].sampleCount;
+    }
+    double *all = malloc((total ? total : 1) * sizeof(double));
+    int k = 0;
+    for (int i = 0; i < started; ++i) {
+        memcpy(all + k, workers[i].samples, workers[i].sampleCount * sizeof(double));
+        k += workers[i].sampleCount;
+    }
+    qsort(all, total, sizeof(double), compareDouble);
+    double p50 = total ? all[total / 2] : 0;
+    double p99 = total ? all[(int)(total * 0.99)] : 0;
+    double rate = (welcomed + refused) / seconds;
+    printf("%11d %11.0f %11.0f %9ld %7ld %8.2f %8.2f\n", concurrency, rate,
+           welcomed / seconds, refused, failed, p50, p99);
+    fflush(stdout);
+
+    free(all);
+    for (int i = 0; i < concurrency; ++i) free(workers[i].samples);
+    free(workers);
+    free(threads);
+    return rate;
+}
+
+/* Double the concurrency until connects/sec improves by less than 5%. */
+void runChurnBenchmark(int maxConcurrency) {
+    printf("Connection churn: %d s per level, up to %d concurrent clients\n",
+           CHURN_LEVEL_SECONDS, maxConcurrency);
+    printf("%11s %11s %11s %9s %7s %8s %8s\n", "concurrency", "connects/s",
+           "welcomed/s", "refused", "failed", "p50 ms", "p99 ms");
+    double best = 0;
+    int bestLevel = 0;
+    for (int c = 1; c <= maxConcurrency; c *= 2) {
+        double rate = churnLevel(c);
+        if (rate < best * 1.05) {
+            printf("Saturated: %.0f connects/s at concurrency %d.\n", best, bestLevel);
+            return;
+        }
+        best = rate;
+        bestLevel = c;
+    }
+    printf("Not saturated at concurrency %d (%.0f connects/s).\n", bestLevel, best);
+}
+
 /*---------------------------------------------------------------------------*
  * main: connect to server, spawn receiver thread, send commands in a loop
  *---------------------------------------------------------------------------*/
 int main(int argc, char *argv[]) {
+    if (argc == 5 && strcmp(argv[1], "--churn") == 0) {
+        memset(&g_serverAddr, 0, sizeof(g_serverAddr));
+        g_serverAddr.sin_family = AF_INET;
+        g_serverAddr.sin_port = htons(atoi(argv[4]));
+        inet_pton(AF_INET, argv[3], &g_serverAddr.sin_addr);
+        runChurnBenchmark(atoi(argv[2]) > 0 ? atoi(argv[2]) : 64);
+        return 0;
+    }
+    if ((argc == 4 || argc == 5) && strcmp(argv[1], "--multicast") == 0) {
+        return runMulticastReceiver(argv[2], atoi(argv[3]), argc == 5 ? argv[4] : NULL);
+    }
+    if (argc == 6 && strcmp(argv[1], "--bots") == 0) {
+        memset(&g_serverAddr, 0, sizeof(g_serverAddr));
+        g_serverAddr.sin_family = AF_INET;
+        g_serverAddr.sin_port = htons(atoi(argv[5]));
+        inet_pton(AF_INET, argv[4], &g_serverAddr.sin_addr);
+        return runBotHost(argv[2], atoi(argv[3]) > 0 ? atoi(argv[3]) : 1);
+    }
+    if (argc == 4 && strcmp(argv[1], "--smooth") == 0) {
+        g_smooth = 1;
+        argv++;
+        argc--;
+    } else if (argc == 4 && strcmp(argv[1], "--terrain") == 0) {
+        g_terrain = 1;
+        if (openChunkCache(CHUNK_CACHE_PATH) < 0) perror("Chunk cache unavailable, downloading every chunk");
+        argv++;
+        argc--;
+    }
     if (argc != 3) {
-        fprintf(stderr, "Usage: %s <SERVER_IP> <PORT>\n", argv[0]);
+        fprintf(stderr, "Usage: %s [--smooth | --terrain] <SERVER_IP> <PORT>\n"
+                        "       %s --multicast <GROUP> <PORT> [INTERFACE_IP]\n"
+                        "       %s --bots <PLUGIN.so> <COUNT> <SERVER_IP> <PORT>\n"
+                        "       %s --churn <MAX_CONCURRENCY> <SERVER_IP> <PORT>\n", argv[0], argv[0], argv[0], argv[0]);
         exit(EXIT_FAILURE);
     }
 
@@ -76,9 +1088,11 @@ int main(int argc, char *argv[]) {
 
     // 2. Build server address struct & connect
     struct sockaddr_in serverAddr;
+    memset(&serverAddr, 0, sizeof(serverAddr));
     serverAddr.sin_family = AF_INET;
     serverAddr.sin_port = htons(port);
     inet_pton(AF_INET, serverIP, &serverAddr.sin_addr);
+    g_serverAddr = serverAddr;
     
     if(connect(g_serverSocket, (struct sockaddr *)&serverAddr, sizeof(serverAddr)) == -1){
       perror("Failed to connect to socket!\n");
@@ -86,18 +1100,27 @@ int main(int argc, char *argv[]) {
     }
 
     printf("Connected to server %s:%d\n", serverIP, port);
+    if (g_terrain) {
+        const char *subscribe = "SUBSCRIBE terrain positions hp\n";
+        send(g_serverSocket, subscribe, strlen(subscribe), 0);
+    }
 
     // 3. Create a receiver thread
     pthread_t recvThread;
-    pthread_create(&recvThread, NULL, receiverThread, (void *) &g_serverSocket);
+    pthread_create(&recvThread, NULL, receiverThread, NULL);
     pthread_detach(recvThread);
+    if (g_smooth) {
+        pthread_t drawThread;
+        pthread_create(&drawThread, NULL, renderThread, NULL);
+        pthread_detach(drawThread);
+    }
 
     // 4. Main loop: read user commands, send to server
     while (1) {
         char command[BUFFER_SIZE];
         memset(command, 0, sizeof(command));
 
-        printf("Enter command (MOVE/ATTACK/QUIT): ");
+        printf("Enter command (MOVE/ATTACK/SAY/TEAM/WATCH/QUIT): ");
         fflush(stdout);
 
         if (fgets(command, sizeof(command), stdin) == NULL) {
@@ -112,12 +1135,18 @@ int main(int argc, char *argv[]) {
             command[len - 1] = '\0';
         }
 
+        // Tell the server which tick we were looking at when we attacked
+        if (strcmp(command, "ATTACK") == 0 && g_haveTick) {
+            snprintf(command + 6, sizeof(command) - 6, " %lu", g_lastTick);
+        }
+
         if (send(g_serverSocket, command, strlen(command), 0) == -1){
 	  perror("Command failed to send!\n");
 	}
 
         // If QUIT => break
         if (strncmp(command, "QUIT", 4) == 0) {
+            g_quitting = 1;
 	    printf("Exiting client.\n");
             break;
         }
@@ -0,0 +1,143 @@
+/*
+ * Config file parsing and atomic publication.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "config.h"
+
+static _Atomic(Config *) current = NULL;
+
+void config_defaults(Config *cfg) {
+    RoomParams room = ROOM_DEFAULT_PARAMS;
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->room = room;
+    cfg->bots = 0;
+    cfg->tick_ms = 250;
+    cfg->idle_tick_ms = 1000;
+    cfg->cmd_rate = 0;
+    cfg->cmd_burst = 10;
+    cfg->resume_grace_ms = 30000;
+    cfg->resume_wait_ms = 200;
+    cfg->join_window_ms = 5;
+    cfg->rewind_ticks = 4;
+    cfg->teams = 2;
+    cfg->chat_rate = 1;
+    cfg->chat_burst = 5;
+    cfg->overload_lag_ms = 50;
+    cfg->overload_queue = 64;
+    cfg->overload_rss_mb = 0;
+    cfg->checkpoint_ms = 1000;
+}
+
+typedef struct {
+    const char *key;
+    size_t offset;
+    int min, max;
+} ConfigKey;
+
+static const ConfigKey KEYS[] = {
+    { "grid_size",   offsetof(Config, room.grid_size),   2, 1024 },
+    { "max_players", offsetof(Config, room.max_players), 1, ROOM_MAX_PLAYERS },
+    // Hit points travel as int16_t in replay and multicast records
+    { "max_hp",      offsetof(Config, room.max_hp),      1, INT16_MAX },
+    { "damage",      offsetof(Config, room.damage),      1, INT16_MAX },
+    { "bots",        offsetof(Config, bots),             0, ROOM_MAX_PLAYERS - 1 },
+    { "tick_ms",     offsetof(Config, tick_ms),          1, 60000 },
+    { "idle_tick_ms",    offsetof(Config, idle_tick_ms),    0, 60000 },
+    { "cmd_rate",    offsetof(Config, cmd_rate),         0, 1000000 },
+    { "cmd_burst",   offsetof(Config, cmd_burst),        1, 1000000 },
+    { "resume_grace_ms", offsetof(Config, resume_grace_ms), 0, 86400000 },
+    { "resume_wait_ms",  offsetof(Config, resume_wait_ms),  0, 10000 },
+    { "join_window_ms",  offsetof(Config, join_window_ms),  0, 1000 },
+    { "rewind_ticks",    offsetof(Config, rewind_ticks),    0, ROOM_REWIND_TICKS - 1 },
+    { "teams",           offsetof(Config, teams),           1, ROOM_MAX_PLAYERS },
+    { "chat_rate",       offsetof(Config, chat_rate),       0, 1000 },
+    { "chat_burst",      offsetof(Config, chat_burst),      1, 1000 },
+    { "overload_lag_ms", offsetof(Config, overload_lag_ms), 0, 60000 },
+    { "overload_queue",  offsetof(Config, overload_queue),  0, 1000000 },
+    { "overload_rss_mb", offsetof(Config, overload_rss_mb), 0, 1000000 },
+    { "checkpoint_ms",   offsetof(Config, checkpoint_ms),   10, 3600000 },
+};
+
+static char *trim(char *s) {
+    while (isspace((unsigned char)*s)) s++;
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1])) *--end = '\0';
+    return s;
+}
+
+int config_load(const char *path, const Config *base, Config *out, char *err, size_t errlen) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        snprintf(err, errlen, "cannot open %s", path);
+        return -1;
+    }
+    Config cfg = *base;
+    char line[256];
+    int lineno = 0, rc = 0;
+    while (rc == 0 && fgets(line, sizeof(line), fp)) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        char *text = trim(line);
+        if (*text == '\0') continue;
+        char *eq = strchr(text, '=');
+        if (!eq) {
+            snprintf(err, errlen, "%s:%d: expected key = value", path, lineno);
+            rc = -1;
+            break;
+        }
+        *eq = '\0';
+        char *key = trim(text), *value = trim(eq + 1), *end;
+        if (strcmp(key, "rule_module") == 0) {
+            // The one string-valued key; loading is left to the server
+            if (strlen(value) >= sizeof(cfg.rule_module)) {
+                snprintf(err, errlen, "%s:%d: rule_module path is too long", path, lineno);
+                rc = -1;
+            } else {
+                strcpy(cfg.rule_module, value);
+            }
+            continue;
+        }
+        long v = strtol(value, &end, 10);
+        const ConfigKey *k = NULL;
+        for (size_t i = 0; i < sizeof(KEYS) / sizeof(KEYS[0]); ++i) {
+            if (strcmp(KEYS[i].key, key) == 0) k = &KEYS[i];
+        }
+        if (!k) {
+            snprintf(err, errlen, "%s:%d: unknown key '%s'", path, lineno, key);
+            rc = -1;
+        } else if (*value == '\0' || *end != '\0' || v < k->min || v > k->max) {
+            snprintf(err, errlen, "%s:%d: %s must be an integer in [%d, %d]",
+                     path, lineno, key, k->min, k->max);
+            rc = -1;
+        } else {
+            *(int *)((char *)&cfg + k->offset) = (int)v;
+        }
+    }
+    fclose(fp);
+    if (rc == 0 && !room_params_valid(&cfg.room)) {
+        snprintf(err, errlen, "%s: room parameters are inconsistent (too many players for the grid?)", path);
+        rc = -1;
+    }
+    if (rc == 0 && cfg.bots >= cfg.room.max_players) {
+        snprintf(err, errlen, "%s: bots must be below max_players", path);
+        rc = -1;
+    }
+    if (rc == 0) *out = cfg;
+    return rc;
+}
+
+void config_publish(Config *cfg) {
+    const Config *old = config_current();
+    cfg->generation = old ? old->generation + 1 : 1;
+    atomic_store_explicit(&current, cfg, memory_order_release);
+}
+
+const Config *config_current(void) {
+    return atomic_load_explicit(&current, memory_order_acquire);
+}
@@ -0,0 +1,53 @@
+/*
+ * Runtime configuration, read from a "key = value" file at startup and again
+ * on SIGHUP. The current Config is published through an atomic pointer, so a
+ * reload swaps every knob at once and readers never take a lock: they load
+ * the pointer once and use that snapshot for the operation at hand.
+ *
+ * Room parameters only affect rooms created after the reload; server knobs
+ * take effect on their next use.
+ */
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stddef.h>
+#include "game.h"
+
+typedef struct {
+    unsigned long generation;  // set by config_publish(), 1 for the first config
+    RoomParams room;           // grid_size, max_players, max_hp, damage
+    int bots;                  // server-side bots kept in the room
+    int tick_ms;               // room tick period at full rate
+    int idle_tick_ms;          // heartbeat period of an idle room, 0 = always tick_ms
+    int cmd_rate;              // commands per second per client, 0 = unlimited
+    int cmd_burst;             // commands a client may send back to back
+    int resume_grace_ms;       // how long a dropped player can RESUME, 0 = off
+    int resume_wait_ms;        // how long a full server waits for a RESUME line
+    int join_window_ms;        // joins arriving this close together are admitted as one batch
+    int rewind_ticks;          // how far back a lagging ATTACK may be resolved, 0 = off
+    int teams;                 // chat teams; a player is on team slot % teams
+    int chat_rate;             // SAY / TEAM messages per second per client, 0 = unlimited
+    int chat_burst;            // chat messages a client may send back to back
+    int overload_lag_ms;       // room tick lateness that counts as overload, 0 = ignore
+    int overload_queue;        // queued connections + commands that count as overload, 0 = ignore
+    int overload_rss_mb;       // resident memory that counts as overload, 0 = ignore
+    int checkpoint_ms;         // how often a persistent world is checkpointed (-C)
+    char rule_module[256];     // shared object with the game rules, "" = built-in
+} Config;
+
+// Built-in defaults (the historical compile-time constants).
+void config_defaults(Config *cfg);
+
+// Parse <path> on top of *base into *out. On error nothing is published and
+// a message is written to err. Returns 0 on success, -1 on error.
+int config_load(const char *path, const Config *base, Config *out, char *err, size_t errlen);
+
+// Publish a new configuration; takes ownership of cfg. Configs that were
+// replaced are kept alive (they are tiny and reloads are rare) so readers
+// holding an old pointer never see freed memory.
+void config_publish(Config *cfg);
+
+// Current configuration. Never NULL after the first config_publish().
+const Config *config_current(void);
+
+#endif
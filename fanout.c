@@ -0,0 +1,338 @@
+/*
+ * Sharded broadcast fan-out. See fanout.h for the delivery contract.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include "fanout.h"
+#include "metrics.h"
+
+typedef struct {
+    atomic_int refs;              // shards that still have to send it
+    struct timespec published;
+    int keep;                     // 1 = never replaced by a newer frame
+    int len;
+    char data[];
+} Frame;
+
+typedef struct {
+    pthread_mutex_t conn_lock;    // guards socks; held while sending
+    int *socks;
+    int count, cap;
+    pthread_mutex_t frame_lock;   // guards the queue
+    pthread_cond_t frame_cond;
+    Frame **queue;                // ring of frames to send, oldest first
+    int head, queued, queue_cap;
+    int stop;                     // set under frame_lock to end the thread
+    pthread_t thread;
+    clockid_t cpu_clock;          // CPU time of the shard's thread
+    long cpu_seen_ns;             // CPU time at the last fanout_balance()
+} Shard;
+
+struct FanoutGroup {
+    int threads;                  // 0 = the publisher sends inline
+    int shard_count;
+    int max_conns;
+    atomic_int total;
+    Shard *shards;
+    pthread_mutex_t map_lock;     // guards shard_of; taken before conn_lock
+    int *shard_of;                // socket -> shard, -1 = not in the group
+    int map_cap;
+};
+
+// Registered once by fanout_create(); updated per frame without the registry lock
+static Metric *m_fanout_ns, *m_dropped;
+
+static long elapsed_ns(const struct timespec *since) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) * 1000000000L + (now.tv_nsec - since->tv_nsec);
+}
+
+// Drop one reference; whoever drops the last one records the fan-out time
+// (publish to last send) and frees the frame.
+static void frame_release(Frame *f, int delivered) {
+    if (atomic_fetch_sub(&f->refs, 1) != 1) return;
+    if (delivered) metric_set(m_fanout_ns, elapsed_ns(&f->published));
+    free(f);
+}
+
+static void send_all(Shard *s, const Frame *f) {
+    pthread_mutex_lock(&s->conn_lock);
+    for (int i = 0; i < s->count; ++i) {
+        // A failed send is cleaned up by the connection's own thread
+        send(s->socks[i], f->data, f->len, 0);
+    }
+    pthread_mutex_unlock(&s->conn_lock);
+}
+
+static void *shard_thread(void *arg) {
+    Shard *s = arg;
+    while (1) {
+        pthread_mutex_lock(&s->frame_lock);
+        while (s->queued == 0 && !s->stop) pthread_cond_wait(&s->frame_cond, &s->frame_lock);
+        if (s->stop) {
+            pthread_mutex_unlock(&s->frame_lock);
+            return NULL;
+        }
+        Frame *f = s->queue[s->head];
+        s->head = (s->head + 1) % s->queue_cap;
+        s->queued--;
+        pthread_mutex_unlock(&s->frame_lock);
+        send_all(s, f);
+        frame_release(f, 1);
+    }
+    return NULL;
+}
+
+// Stop and join the first <started> shard threads, then free the group.
+// Only used when fanout_create() fails part way.
+static void destroy_group(FanoutGroup *g, int started) {
+    for (int i = 0; i < started; ++i) {
+        Shard *s = &g->shards[i];
+        pthread_mutex_lock(&s->frame_lock);
+        s->stop = 1;
+        pthread_cond_signal(&s->frame_cond);
+        pthread_mutex_unlock(&s->frame_lock);
+        pthread_join(s->thread, NULL);
+    }
+    for (int i = 0; i < g->shard_count; ++i) {
+        pthread_mutex_destroy(&g->shards[i].conn_lock);
+        pthread_mutex_destroy(&g->shards[i].frame_lock);
+        pthread_cond_destroy(&g->shards[i].frame_cond);
+        free(g->shards[i].queue);
+    }
+    pthread_mutex_destroy(&g->map_lock);
+    free(g->shards);
+    free(g);
+}
+
+FanoutGroup *fanout_create(int threads, int max_conns) {
+    m_fanout_ns = metric_register("fanout_ns", METRIC_GAUGE);
+    m_dropped = metric_register("fanout_frames_dropped_total", METRIC_COUNTER);
+    FanoutGroup *g = calloc(1, sizeof(*g));
+    if (!g) return NULL;
+    g->threads = threads > 0 ? threads : 0;
+    g->shard_count = threads > 0 ? threads : 1;
+    g->max_conns = max_conns;
+    atomic_init(&g->total, 0);
+    pthread_mutex_init(&g->map_lock, NULL);
+    g->shards = calloc(g->shard_count, sizeof(Shard));
+    if (!g->shards) {
+        free(g);
+        return NULL;
+    }
+    for (int i = 0; i < g->shard_count; ++i) {
+        Shard *s = &g->shards[i];
+        pthread_mutex_init(&s->conn_lock, NULL);
+        pthread_mutex_init(&s->frame_lock, NULL);
+        pthread_cond_init(&s->frame_cond, NULL);
+    }
+    // Shard threads only send; they must never be picked to handle a
+    // process signal (the server waits for SIGHUP in one thread), whatever
+    // mask the caller has
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int started = 0;
+    while (started < g->threads &&
+           pthread_create(&g->shards[started].thread, NULL, shard_thread, &g->shards[started]) == 0) {
+        started++;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (started < g->threads) {
+        destroy_group(g, started);
+        return NULL;
+    }
+    for (int i = 0; i < g->threads; ++i) {
+        Shard *s = &g->shards[i];
+        if (pthread_getcpuclockid(s->thread, &s->cpu_clock) != 0) s->cpu_clock = CLOCK_THREAD_CPUTIME_ID;
+        pthread_detach(s->thread);
+    }
+    return g;
+}
+
+static int shard_append(Shard *s, int sockfd) {
+    if (s->count == s->cap) {
+        int cap = s->cap ? s->cap * 2 : 64;
+        int *grown = realloc(s->socks, cap * sizeof(int));
+        if (!grown) return -1;
+        s->socks = grown;
+        s->cap = cap;
+    }
+    s->socks[s->count++] = sockfd;
+    return 0;
+}
+
+int fanout_add(FanoutGroup *g, int sockfd) {
+    if (atomic_fetch_add(&g->total, 1) >= g->max_conns) {
+        atomic_fetch_sub(&g->total, 1);
+        return -1;
+    }
+    pthread_mutex_lock(&g->map_lock);
+    if (sockfd >= g->map_cap) {
+        int cap = g->map_cap ? g->map_cap : 1024;
+        while (cap <= sockfd) cap *= 2;
+        int *grown = realloc(g->shard_of, cap * sizeof(int));
+        if (!grown) {
+            pthread_mutex_unlock(&g->map_lock);
+            atomic_fetch_sub(&g->total, 1);
+            return -1;
+        }
+        for (int i = g->map_cap; i < cap; ++i) grown[i] = -1;
+        g->shard_of = grown;
+        g->map_cap = cap;
+    }
+    // New connections go to the shard with the fewest; fanout_balance()
+    // evens out CPU later
+    int pick = 0;
+    for (int i = 1; i < g->shard_count; ++i) {
+        if (g->shards[i].count < g->shards[pick].count) pick = i;
+    }
+    Shard *s = &g->shards[pick];
+    pthread_mutex_lock(&s->conn_lock);
+    int rc = shard_append(s, sockfd);
+    pthread_mutex_unlock(&s->conn_lock);
+    if (rc == 0) {
+        g->shard_of[sockfd] = pick;
+    } else {
+        atomic_fetch_sub(&g->total, 1);
+    }
+    pthread_mutex_unlock(&g->map_lock);
+    return rc;
+}
+
+void fanout_remove(FanoutGroup *g, int sockfd) {
+    pthread_mutex_lock(&g->map_lock);
+    int shard = sockfd < g->map_cap ? g->shard_of[sockfd] : -1;
+    if (shard >= 0) {
+        Shard *s = &g->shards[shard];
+        pthread_mutex_lock(&s->conn_lock);
+        for (int i = 0; i < s->count; ++i) {
+            if (s->socks[i] == sockfd) {
+                s->socks[i] = s->socks[--s->count];
+                atomic_fetch_sub(&g->total, 1);
+                break;
+            }
+        }
+        pthread_mutex_unlock(&s->conn_lock);
+        g->shard_of[sockfd] = -1;
+    }
+    pthread_mutex_unlock(&g->map_lock);
+}
+
+static long cpu_ns(clockid_t clock) {
+    struct timespec ts;
+    if (clock_gettime(clock, &ts) != 0) return 0;
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+int fanout_balance(FanoutGroup *g) {
+    if (g->threads < 2) return 0;
+    // CPU each shard thread used since the last call
+    int hot = 0, cold = 0;
+    long used[g->shard_count];
+    for (int i = 0; i < g->shard_count; ++i) {
+        Shard *s = &g->shards[i];
+        long now = cpu_ns(s->cpu_clock);
+        used[i] = now - s->cpu_seen_ns;
+        s->cpu_seen_ns = now;
+        if (used[i] > used[hot]) hot = i;
+        if (used[i] < used[cold]) cold = i;
+    }
+    metric_set(metric_register("fanout_shard_cpu_max_ns", METRIC_GAUGE), used[hot]);
+    if (used[hot] == 0 || (used[hot] - used[cold]) * 100 < used[hot] * FANOUT_IMBALANCE_PERCENT) return 0;
+
+    pthread_mutex_lock(&g->map_lock);
+    Shard *from = &g->shards[hot], *to = &g->shards[cold];
+    // Lock both shards in index order; neither thread sends meanwhile
+    pthread_mutex_lock(&g->shards[hot < cold ? hot : cold].conn_lock);
+    pthread_mutex_lock(&g->shards[hot < cold ? cold : hot].conn_lock);
+    // Move the share of connections that evens out the measured CPU,
+    // assuming every connection on the hot shard costs the same
+    long move = (long)from->count * (used[hot] - used[cold]) / (2 * used[hot]);
+    if (move > FANOUT_MIGRATE_MAX) move = FANOUT_MIGRATE_MAX;
+    int moved = 0;
+    while (moved < move && shard_append(to, from->socks[from->count - 1]) == 0) {
+        g->shard_of[from->socks[--from->count]] = cold;
+        moved++;
+    }
+    pthread_mutex_unlock(&g->shards[hot < cold ? cold : hot].conn_lock);
+    pthread_mutex_unlock(&g->shards[hot < cold ? hot : cold].conn_lock);
+    pthread_mutex_unlock(&g->map_lock);
+    if (moved > 0) metric_add(metric_register("fanout_migrations_total", METRIC_COUNTER), moved);
+    return moved;
+}
+
+int fanout_count(FanoutGroup *g) {
+    return atomic_load(&g->total);
+}
+
+// Queue f on s and return the frame it replaces, if any. A snapshot only
+// replaces a snapshot still waiting at the tail, so frames that must all
+// arrive (and the order between them and snapshots) are never lost.
+// Called with s->frame_lock held.
+static Frame *shard_enqueue(Shard *s, Frame *f) {
+    if (s->queued > 0) {
+        int tail = (s->head + s->queued - 1) % s->queue_cap;
+        if (!f->keep && !s->queue[tail]->keep) {
+            Frame *stale = s->queue[tail];
+            s->queue[tail] = f;
+            return stale;
+        }
+    }
+    if (s->queued == s->queue_cap) {
+        int cap = s->queue_cap ? s->queue_cap * 2 : 8;
+        Frame **grown = malloc(cap * sizeof(Frame *));
+        if (!grown) return f;
+        for (int i = 0; i < s->queued; ++i) grown[i] = s->queue[(s->head + i) % s->queue_cap];
+        free(s->queue);
+        s->queue = grown;
+        s->queue_cap = cap;
+        s->head = 0;
+    }
+    s->queue[(s->head + s->queued) % s->queue_cap] = f;
+    s->queued++;
+    return NULL;
+}
+
+static void publish(FanoutGroup *g, const char *data, int len, int keep) {
+    if (atomic_load(&g->total) == 0) return;
+    Frame *f = malloc(sizeof(*f) + len);
+    if (!f) return;
+    clock_gettime(CLOCK_MONOTONIC, &f->published);
+    f->keep = keep;
+    f->len = len;
+    memcpy(f->data, data, len);
+    if (g->threads == 0) {
+        atomic_init(&f->refs, 1);
+        send_all(&g->shards[0], f);
+        frame_release(f, 1);
+        return;
+    }
+    // Serialize once, share the buffer across every shard
+    atomic_init(&f->refs, g->shard_count);
+    for (int i = 0; i < g->shard_count; ++i) {
+        Shard *s = &g->shards[i];
+        pthread_mutex_lock(&s->frame_lock);
+        Frame *stale = shard_enqueue(s, f);
+        pthread_cond_signal(&s->frame_cond);
+        pthread_mutex_unlock(&s->frame_lock);
+        if (stale) {
+            metric_add(m_dropped, 1);
+            frame_release(stale, 0);
+        }
+    }
+}
+
+void fanout_publish(FanoutGroup *g, const char *data, int len) {
+    publish(g, data, len, 0);
+}
+
+void fanout_append(FanoutGroup *g, const char *data, int len) {
+    publish(g, data, len, 1);
+}
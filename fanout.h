@@ -0,0 +1,55 @@
+/*
+ * Broadcast fan-out to large sets of connections (live spectators).
+ *
+ * A FanoutGroup partitions its sockets across I/O threads (shards); a new
+ * socket joins the shard with the fewest.
+ * fanout_publish() and fanout_append() copy a frame once into a shared,
+ * reference-counted buffer and queue it on every thread; each thread then
+ * sends its queue, in order, to its own connections, so the publisher
+ * (holding state_lock) never loops over the whole set and delivery time
+ * shrinks as threads are added.
+ *
+ * fanout_publish() frames are full state snapshots: if a thread is still
+ * busy when a newer snapshot arrives and the last frame it has queued is an
+ * older snapshot, that one is dropped and only the newest is delivered.
+ * fanout_append() frames (chat) are always delivered, in publish order
+ * relative to everything else.
+ *
+ * With zero I/O threads the publisher sends inline, as before.
+ *
+ * Load per connection is uneven (slow receivers, large send buffers), so
+ * fanout_balance() moves sockets from the shard thread that used the most
+ * CPU to the one that used the least. A socket is moved between frames
+ * with both shards locked, so its client sees no gap or duplicate.
+ */
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#define FANOUT_IMBALANCE_PERCENT 25   // CPU gap between shards that triggers a move
+#define FANOUT_MIGRATE_MAX 4096       // most sockets moved per fanout_balance()
+
+typedef struct FanoutGroup FanoutGroup;
+
+// Create a group served by <threads> I/O threads (0 = send inline) that
+// holds at most <max_conns> connections. Returns NULL on failure.
+FanoutGroup *fanout_create(int threads, int max_conns);
+
+// Add or remove a connection. fanout_add() returns -1 if the group is full.
+// Once fanout_remove() returns no thread will send to sockfd again, so the
+// caller may close it.
+int fanout_add(FanoutGroup *g, int sockfd);
+void fanout_remove(FanoutGroup *g, int sockfd);
+int fanout_count(FanoutGroup *g);
+
+// Deliver len bytes of data to every connection in the group. A snapshot
+// may be superseded by the next fanout_publish(); an appended frame never is.
+void fanout_publish(FanoutGroup *g, const char *data, int len);
+void fanout_append(FanoutGroup *g, const char *data, int len);
+
+// Compare the CPU each shard thread used since the last call and, if the
+// busiest used FANOUT_IMBALANCE_PERCENT more than the idlest, move
+// connections from one to the other. Call periodically (the server does
+// once a second). Returns the number of connections moved.
+int fanout_balance(FanoutGroup *g);
+
+#endif
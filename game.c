@@ -0,0 +1,446 @@
+/*
+ * Game rules: spawning, movement, adjacency attacks and state rendering.
+ * See game.h for the contract; nothing in this file performs I/O.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "game.h"
+#include "rules.h"
+
+static void emit(Room *room, EventList *events, EventType type, int slot, int target, int value) {
+    Event e;
+    e.seq = ++room->event_seq;
+    e.type = type;
+    e.slot = slot;
+    e.target = target;
+    e.value = value;
+    e.row = room->players[slot].row;
+    e.col = room->players[slot].col;
+    // Every state change emits an event, so this is where slots get dirty
+    if (type != EV_MOVE_BLOCKED) room->player_dirty |= 1u << slot;
+    if (target >= 0) room->player_dirty |= 1u << target;
+    if (room->log_count < ROOM_EVENT_LOG) {
+        room->log[room->log_count++] = e;
+    } else {
+        room->events_dropped++;
+    }
+    if (events && events->count < ROOM_EVENTS_MAX) events->items[events->count++] = e;
+}
+
+int room_take_events(Room *room, Event *out, int max) {
+    int n = room->log_count < max ? room->log_count : max;
+    memcpy(out, room->log, n * sizeof(Event));
+    memmove(room->log, room->log + n, (room->log_count - n) * sizeof(Event));
+    room->log_count -= n;
+    return n;
+}
+
+int room_params_valid(const RoomParams *params) {
+    return params->grid_size >= 2 && params->grid_size <= 1024 &&
+           params->max_players >= 1 && params->max_players <= ROOM_MAX_PLAYERS &&
+           params->max_players < params->grid_size * params->grid_size / 2 &&
+           params->max_hp > 0 && params->damage > 0;
+}
+
+Room *room_create(const RoomParams *params, unsigned int seed) {
+    if (!room_params_valid(params)) return NULL;
+    Room *room = calloc(1, sizeof(*room));
+    if (!room) return NULL;
+    int n = params->grid_size;
+    room->params = *params;
+    room->rules = &room_default_rules;
+    room->seed = seed;
+    room->rng = seed;
+    room->obstacles = calloc(n * n, sizeof(int));
+    room->players = calloc(params->max_players, sizeof(Player));
+    room->log = malloc(ROOM_EVENT_LOG * sizeof(Event));
+    room->past_row = malloc(ROOM_REWIND_TICKS * params->max_players * sizeof(int16_t));
+    room->past_col = malloc(ROOM_REWIND_TICKS * params->max_players * sizeof(int16_t));
+    int chunks = room_chunks_per_side(room);
+    room->chunk_dirty = malloc(chunks * chunks);
+    room->chunk_hash = malloc(chunks * chunks * sizeof(uint64_t));
+    if (!room->obstacles || !room->players || !room->log || !room->past_row || !room->past_col ||
+        !room->chunk_dirty || !room->chunk_hash) {
+        room_destroy(room);
+        return NULL;
+    }
+    // Place random obstacles: 3 to 5 on the classic 5x5 grid, scaled by area
+    int obstacle_count = (3 + rand_r(&room->rng) % 3) * (n * n) / 25;
+    if (obstacle_count < 1) obstacle_count = 1;
+    for (int k = 0; k < obstacle_count; ++k) {
+        int r = rand_r(&room->rng) % n;
+        int c = rand_r(&room->rng) % n;
+        if (room->obstacles[r * n + c] == 1) {
+            k--; // already an obstacle here, try again
+        } else {
+            room->obstacles[r * n + c] = 1;
+        }
+    }
+    // A new room has never been persisted: everything is dirty
+    memset(room->chunk_dirty, 1, chunks * chunks);
+    room->player_dirty = ~0u;
+    for (int i = 0; i < chunks * chunks; ++i) {
+        uint8_t bits[TERRAIN_CHUNK_BYTES];
+        room_chunk_bits(room, i, bits);
+        room->chunk_hash[i] = terrain_chunk_hash(bits);
+    }
+    room->terrain_version = 1;
+    return room;
+}
+
+void room_destroy(Room *room) {
+    if (!room) return;
+    free(room->obstacles);
+    free(room->players);
+    free(room->log);
+    free(room->past_row);
+    free(room->past_col);
+    free(room->chunk_dirty);
+    free(room->chunk_hash);
+    free(room);
+}
+
+void room_set_obstacle(Room *room, int row, int col, int blocked) {
+    int n = room->params.grid_size;
+    if (room->obstacles[row * n + col] == blocked) return;
+    room->obstacles[row * n + col] = blocked;
+    int chunk = (row / ROOM_CHUNK) * room_chunks_per_side(room) + col / ROOM_CHUNK;
+    uint8_t bits[TERRAIN_CHUNK_BYTES];
+    room_chunk_bits(room, chunk, bits);
+    room->chunk_hash[chunk] = terrain_chunk_hash(bits);
+    room->chunk_dirty[chunk] = 1;
+    room->terrain_version++;
+    room->version++;
+}
+
+void room_chunk_bits(const Room *room, int chunk, uint8_t *bits) {
+    int n = room->params.grid_size;
+    int per_side = room_chunks_per_side(room);
+    int r0 = chunk / per_side * ROOM_CHUNK, c0 = chunk % per_side * ROOM_CHUNK;
+    memset(bits, 0, TERRAIN_CHUNK_BYTES);
+    for (int r = 0; r < ROOM_CHUNK && r0 + r < n; ++r) {
+        for (int c = 0; c < ROOM_CHUNK && c0 + c < n; ++c) {
+            int bit = r * ROOM_CHUNK + c;
+            if (room->obstacles[(r0 + r) * n + c0 + c]) bits[bit / 8] |= 1 << (bit % 8);
+        }
+    }
+}
+
+void room_load_chunk(Room *room, int chunk, const uint8_t *bits) {
+    int n = room->params.grid_size;
+    int per_side = room_chunks_per_side(room);
+    int r0 = chunk / per_side * ROOM_CHUNK, c0 = chunk % per_side * ROOM_CHUNK;
+    for (int r = 0; r < ROOM_CHUNK && r0 + r < n; ++r) {
+        for (int c = 0; c < ROOM_CHUNK && c0 + c < n; ++c) {
+            int bit = r * ROOM_CHUNK + c;
+            room->obstacles[(r0 + r) * n + c0 + c] = (bits[bit / 8] >> (bit % 8)) & 1;
+        }
+    }
+    room->chunk_hash[chunk] = terrain_chunk_hash(bits);
+    room->chunk_dirty[chunk] = 1;
+}
+
+int room_player_at(const Room *room, int r, int c) {
+    for (int q = 0; q < room->params.max_players; ++q) {
+        const Player *p = &room->players[q];
+        if (p->active && p->row == r && p->col == c) return q;
+    }
+    return -1;
+}
+
+static void remove_player(Room *room, int slot) {
+    Player *p = &room->players[slot];
+    if (p->is_bot) room->bot_count--;
+    p->active = 0;
+    p->is_bot = 0;
+    room->player_count--;
+}
+
+int room_spawn(Room *room, int slot, int is_bot, EventList *events) {
+    if (slot < 0) {
+        for (int i = 0; i < room->params.max_players; ++i) {
+            if (!room->players[i].active) {
+                slot = i;
+                break;
+            }
+        }
+    }
+    if (slot < 0 || slot >= room->params.max_players || room->players[slot].active) {
+        return -1;
+    }
+    // Find a random free position (not an obstacle and not occupied by another player)
+    int n = room->params.grid_size;
+    int r, c;
+    do {
+        r = rand_r(&room->rng) % n;
+        c = rand_r(&room->rng) % n;
+    } while (room->obstacles[r * n + c] == 1 || room_player_at(room, r, c) >= 0);
+
+    Player *p = &room->players[slot];
+    p->row = r;
+    p->col = c;
+    p->hp = room->rules->spawn_hp(room, slot);
+    p->active = 1;
+    p->is_bot = is_bot;
+    room->player_count++;
+    if (is_bot) room->bot_count++;
+    room->version++;
+    emit(room, events, EV_JOIN, slot, -1, 0);
+    return slot;
+}
+
+int room_spawn_batch(Room *room, int count, int is_bot, int *slots, EventList *events) {
+    int n = room->params.grid_size;
+    int *free_cells = malloc((size_t)n * n * sizeof(int));
+    unsigned char *taken = calloc((size_t)n * n, 1);
+    if (!free_cells || !taken) {
+        // Fall back to one spawn at a time
+        free(free_cells);
+        free(taken);
+        int spawned = 0;
+        while (spawned < count && (slots[spawned] = room_spawn(room, -1, is_bot, events)) >= 0) {
+            spawned++;
+        }
+        return spawned;
+    }
+    for (int q = 0; q < room->params.max_players; ++q) {
+        const Player *p = &room->players[q];
+        if (p->active) taken[p->row * n + p->col] = 1;
+    }
+    int free_count = 0;
+    for (int cell = 0; cell < n * n; ++cell) {
+        if (!room->obstacles[cell] && !taken[cell]) free_cells[free_count++] = cell;
+    }
+    int spawned = 0;
+    for (int slot = 0; slot < room->params.max_players && spawned < count && free_count > 0; ++slot) {
+        Player *p = &room->players[slot];
+        if (p->active) continue;
+        // Draw a free cell and swap the last one into its place
+        int pick = rand_r(&room->rng) % free_count;
+        int cell = free_cells[pick];
+        free_cells[pick] = free_cells[--free_count];
+        p->row = cell / n;
+        p->col = cell % n;
+        p->hp = room->rules->spawn_hp(room, slot);
+        p->active = 1;
+        p->is_bot = is_bot;
+        room->player_count++;
+        if (is_bot) room->bot_count++;
+        emit(room, events, EV_JOIN, slot, -1, 0);
+        slots[spawned++] = slot;
+    }
+    if (spawned > 0) room->version++;
+    free(free_cells);
+    free(taken);
+    return spawned;
+}
+
+static RoomResult apply_move(Room *room, int slot, int dr, int dc, EventList *events) {
+    Player *p = &room->players[slot];
+    int newR = p->row + dr;
+    int newC = p->col + dc;
+    RoomResult result = room->rules->check_move(room, slot, newR, newC);
+    if (result != RES_OK) {
+        emit(room, events, EV_MOVE_BLOCKED, slot, -1, result);
+        return result;
+    }
+    p->row = newR;
+    p->col = newC;
+    room->version++;
+    emit(room, events, EV_MOVE, slot, -1, 0);
+    return RES_OK;
+}
+
+// Damage every player in reach of slot, removing those whose HP reaches zero.
+// With rewind > 0 adjacency is judged against where the targets stood
+// <rewind> ticks ago (what a lagging attacker saw); damage still applies to
+// players that are active now.
+static RoomResult apply_attack(Room *room, int slot, int rewind, EventList *events) {
+    int attackerR = room->players[slot].row;
+    int attackerC = room->players[slot].col;
+    if (rewind > (int)room->tick) rewind = room->tick;
+    if (rewind >= ROOM_REWIND_TICKS) rewind = ROOM_REWIND_TICKS - 1;
+    const int16_t *past_row = NULL, *past_col = NULL;
+    if (rewind > 0) {
+        size_t base = ((room->tick - rewind) % ROOM_REWIND_TICKS) * room->params.max_players;
+        past_row = room->past_row + base;
+        past_col = room->past_col + base;
+    }
+    int hit = 0;
+    for (int q = 0; q < room->params.max_players; ++q) {
+        Player *target = &room->players[q];
+        if (!target->active || q == slot) continue;
+        int targetR = target->row, targetC = target->col;
+        if (past_row) {
+            if (past_row[q] < 0) continue; // not on the board back then
+            targetR = past_row[q];
+            targetC = past_col[q];
+        }
+        int damage = room->rules->attack_damage(room, slot, q, targetR - attackerR, targetC - attackerC);
+        if (damage > 0) {
+            target->hp -= damage;
+            emit(room, events, EV_HIT, slot, q, damage);
+            if (target->hp <= 0) {
+                // Player is dead, remove them from game
+                target->hp = 0;
+                remove_player(room, q);
+                emit(room, events, EV_KILL, slot, q, 0);
+            }
+            hit = 1;
+        }
+    }
+    if (!hit) return RES_NO_TARGET;
+    room->version++;
+    return RES_OK;
+}
+
+void room_end_tick(Room *room) {
+    size_t base = (room->tick % ROOM_REWIND_TICKS) * room->params.max_players;
+    for (int q = 0; q < room->params.max_players; ++q) {
+        const Player *p = &room->players[q];
+        room->past_row[base + q] = p->active ? p->row : -1;
+        room->past_col[base + q] = p->active ? p->col : -1;
+    }
+    room->tick++;
+}
+
+RoomResult room_apply(Room *room, const Cmd *cmd, EventList *events) {
+    if (cmd->slot < 0 || cmd->slot >= room->params.max_players ||
+        !room->players[cmd->slot].active) {
+        return RES_INVALID;
+    }
+    switch (cmd->type) {
+    case CMD_MOVE:
+        return apply_move(room, cmd->slot, cmd->dr, cmd->dc, events);
+    case CMD_ATTACK:
+        return apply_attack(room, cmd->slot, cmd->rewind, events);
+    case CMD_LEAVE:
+        remove_player(room, cmd->slot);
+        room->version++;
+        emit(room, events, EV_LEAVE, cmd->slot, -1, 0);
+        return RES_OK;
+    }
+    return RES_INVALID;
+}
+
+// -------- Built-in rules --------
+static RoomResult classic_check_move(const Room *room, int slot, int row, int col) {
+    (void)slot;
+    int n = room->params.grid_size;
+    // Check bounds and obstacles/players
+    if (row < 0 || row >= n || col < 0 || col >= n) return RES_OUT_OF_BOUNDS;
+    if (room->obstacles[row * n + col] == 1) return RES_OBSTACLE;
+    if (room_player_at(room, row, col) >= 0) return RES_OCCUPIED;
+    return RES_OK;
+}
+
+static int classic_attack_damage(const Room *room, int attacker, int target, int dr, int dc) {
+    (void)attacker;
+    (void)target;
+    // Check adjacency (Manhattan distance 1)
+    if ((abs(dr) == 1 && dc == 0) || (abs(dc) == 1 && dr == 0)) return room->params.damage;
+    return 0;
+}
+
+static int classic_spawn_hp(const Room *room, int slot) {
+    (void)slot;
+    return room->params.max_hp;
+}
+
+const RuleModule room_default_rules = {
+    .abi = RULES_ABI,
+    .name = "classic",
+    .version = 0,
+    .check_move = classic_check_move,
+    .attack_damage = classic_attack_damage,
+    .spawn_hp = classic_spawn_hp,
+};
+
+// -------- Rendering --------
+size_t game_state_cap(int grid_size, int slots) {
+    // "Grid:\n", rows of "c " plus newline, "Players:\n", one line per slot
+    return 16 + (size_t)grid_size * (grid_size * 2 + 1) + (size_t)slots * 48;
+}
+
+// Append the "Grid:" section at out + offset; returns the new offset.
+static size_t format_grid(char *out, size_t cap, size_t offset, int grid_size,
+                          const int *cells, const Player *players, int slots) {
+    offset += snprintf(out + offset, cap - offset, "Grid:\n");
+    for (int r = 0; r < grid_size && offset < cap; ++r) {
+        for (int c = 0; c < grid_size && offset + 2 < cap; ++c) {
+            char cell = '.'; // default empty cell
+            if (cells[r * grid_size + c] == 1) {
+                cell = 'X'; // obstacle
+            }
+            // Check if any active player is at this cell
+            for (int p = 0; p < slots; ++p) {
+                if (players[p].active && players[p].row == r && players[p].col == c) {
+                    cell = room_symbol(p);
+                    break;
+                }
+            }
+            // Add cell to message (with a space for readability)
+            out[offset++] = cell;
+            out[offset++] = ' ';
+        }
+        if (offset < cap) offset += snprintf(out + offset, cap - offset, "\n");
+    }
+    return offset;
+}
+
+static int finish(char *out, size_t cap, size_t offset) {
+    if (offset >= cap) offset = cap - 1;
+    out[offset] = '\0';
+    return offset;
+}
+
+int game_format_state(char *out, size_t cap, int grid_size, const int *cells,
+                      const Player *players, int slots) {
+    // Build grid representation
+    size_t offset = format_grid(out, cap, 0, grid_size, cells, players, slots);
+    // Build players info section
+    if (offset < cap) offset += snprintf(out + offset, cap - offset, "Players:\n");
+    for (int p = 0; p < slots && offset < cap; ++p) {
+        if (players[p].active) {
+            offset += snprintf(out + offset, cap - offset, "%c: HP=%d at (%d,%d)\n",
+                               room_symbol(p), players[p].hp,
+                               players[p].row, players[p].col);
+        }
+    }
+    return finish(out, cap, offset);
+}
+
+int room_format_grid(const Room *room, char *out, size_t cap) {
+    size_t offset = format_grid(out, cap, 0, room->params.grid_size, room->obstacles,
+                                room->players, room->params.max_players);
+    return finish(out, cap, offset);
+}
+
+int room_format_positions(const Room *room, char *out, size_t cap) {
+    size_t offset = snprintf(out, cap, "Positions:\n");
+    for (int p = 0; p < room->params.max_players && offset < cap; ++p) {
+        const Player *pl = &room->players[p];
+        if (pl->active) {
+            offset += snprintf(out + offset, cap - offset, "%c: (%d,%d)\n",
+                               room_symbol(p), pl->row, pl->col);
+        }
+    }
+    return finish(out, cap, offset);
+}
+
+int room_format_hp(const Room *room, char *out, size_t cap) {
+    size_t offset = snprintf(out, cap, "HP:\n");
+    for (int p = 0; p < room->params.max_players && offset < cap; ++p) {
+        const Player *pl = &room->players[p];
+        if (pl->active) {
+            offset += snprintf(out + offset, cap - offset, "%c: %d\n", room_symbol(p), pl->hp);
+        }
+    }
+    return finish(out, cap, offset);
+}
+
+int room_serialize(const Room *room, char *out, size_t cap) {
+    return game_format_state(out, cap, room->params.grid_size, room->obstacles,
+                             room->players, room->params.max_players);
+}
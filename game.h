@@ -0,0 +1,176 @@
+/*
+ * Game core for the ASCII Battle Game.
+ *
+ * A Room holds one grid, its obstacles and its player slots, and applies the
+ * game rules to commands. The core performs no I/O: it never sends, closes or
+ * prints anything. Callers learn what happened from the returned result code
+ * and the events appended to an EventList, and decide for themselves what to
+ * send to whom. The TCP server, replay playback, bots and the headless
+ * benchmark all embed it.
+ *
+ * A Room is not thread-safe; callers serialize access (the server uses
+ * state_lock).
+ */
+#ifndef GAME_H
+#define GAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "terrain.h"
+
+#define ROOM_MAX_PLAYERS 26   // player symbols are 'A'..'Z'
+#define ROOM_EVENTS_MAX 16    // enough for any single command
+#define ROOM_EVENT_LOG 4096   // events a room keeps until room_take_events()
+#define ROOM_REWIND_TICKS 32  // depth of the per-tick position history
+#define ROOM_CHUNK TERRAIN_CHUNK   // side of an obstacle chunk (terrain.h)
+
+typedef struct {
+    int grid_size;
+    int max_players;
+    int max_hp;
+    int damage;
+} RoomParams;
+
+#define ROOM_DEFAULT_PARAMS { 5, 4, 100, 20 }
+
+typedef struct {
+    int row, col;      // Current position on the grid
+    int hp;            // Hit points
+    int active;        // Whether this player slot is active (1) or free (0)
+    int is_bot;        // Slot is driven by a server-side bot
+} Player;
+
+typedef enum { CMD_MOVE, CMD_ATTACK, CMD_LEAVE } CmdType;
+
+typedef struct {
+    CmdType type;
+    int slot;                // player issuing the command
+    int dr, dc;              // step for CMD_MOVE
+    int rewind;              // CMD_ATTACK: resolve against targets' positions
+                             // this many ticks ago (0 = now)
+} Cmd;
+
+typedef enum {
+    RES_OK,
+    RES_OUT_OF_BOUNDS,       // MOVE off the grid
+    RES_OBSTACLE,            // MOVE into an obstacle
+    RES_OCCUPIED,            // MOVE into another player
+    RES_NO_TARGET,           // ATTACK with nobody adjacent
+    RES_FULL,                // no free slot to spawn into
+    RES_INVALID,             // bad slot or inactive player
+} RoomResult;
+
+typedef enum { EV_JOIN, EV_LEAVE, EV_MOVE, EV_MOVE_BLOCKED, EV_HIT, EV_KILL } EventType;
+
+typedef struct {
+    unsigned long seq;       // position in the room's event stream, from 1
+    EventType type;
+    int slot;                // acting player (attacker for EV_HIT / EV_KILL)
+    int target;              // victim for EV_HIT / EV_KILL, otherwise -1
+    int value;               // damage for EV_HIT, RoomResult for EV_MOVE_BLOCKED
+    int row, col;            // position after EV_JOIN / EV_MOVE
+} Event;
+
+typedef struct {
+    Event items[ROOM_EVENTS_MAX];
+    int count;
+} EventList;
+
+typedef struct RuleModule RuleModule;   // see rules.h
+
+typedef struct {
+    RoomParams params;
+    const RuleModule *rules; // never NULL; room_default_rules unless swapped
+    unsigned int seed;       // seed the map was generated from
+    unsigned int rng;        // rand_r() state for spawns
+    int *obstacles;          // grid_size * grid_size cells, row-major, 1 = obstacle
+    Player *players;         // params.max_players slots
+    int player_count;        // active slots, bots included
+    int bot_count;           // active slots with is_bot set
+    unsigned long version;   // incremented on every state change
+    Event *log;              // ROOM_EVENT_LOG events not yet taken
+    int log_count;
+    unsigned long event_seq; // seq of the last event emitted
+    unsigned long events_dropped; // emitted while the log was full
+    unsigned long tick;      // completed room ticks (room_end_tick calls)
+    // Positions at the end of each of the last ROOM_REWIND_TICKS ticks, as
+    // int16 columns of max_players entries per tick (-1 = slot inactive).
+    // Tick t lives at (t % ROOM_REWIND_TICKS) * max_players.
+    int16_t *past_row, *past_col;
+    // Dirty tracking for incremental checkpoints (checkpoint.h): one flag
+    // per ROOM_CHUNK x ROOM_CHUNK block of obstacles, row-major, and one bit
+    // per player slot. The core sets them on every change; whoever persists
+    // the room clears them.
+    uint8_t *chunk_dirty;    // room_chunks_per_side()^2 flags
+    uint32_t player_dirty;   // bit per slot
+    // Content hash of every chunk (terrain_chunk_hash()), kept current by
+    // room_set_obstacle(), and a counter bumped whenever any chunk changes
+    uint64_t *chunk_hash;
+    unsigned long terrain_version;
+} Room;
+
+// Create a room with randomly placed obstacles derived from seed.
+// Returns NULL on invalid parameters or allocation failure.
+Room *room_create(const RoomParams *params, unsigned int seed);
+void room_destroy(Room *room);
+int room_params_valid(const RoomParams *params);
+
+// Put a player on a random free cell. slot < 0 picks the first free slot.
+// Returns the slot used, or -1 if the room is full or the slot is taken.
+int room_spawn(Room *room, int slot, int is_bot, EventList *events);
+
+// Spawn up to <count> players into the lowest free slots in one pass: the
+// free cells are collected once and drawn without replacement, instead of
+// rejection-sampling every spawn against every player. Writes the slots used
+// to slots[] and returns how many were spawned.
+int room_spawn_batch(Room *room, int count, int is_bot, int *slots, EventList *events);
+
+// Change one obstacle cell and mark its chunk dirty. Every write to
+// room->obstacles after room_create() must go through here.
+void room_set_obstacle(Room *room, int row, int col, int blocked);
+
+static inline int room_chunks_per_side(const Room *room) {
+    return (room->params.grid_size + ROOM_CHUNK - 1) / ROOM_CHUNK;
+}
+
+// Copy chunk <chunk> out as a TERRAIN_CHUNK_BYTES bitmap (layout in terrain.h).
+void room_chunk_bits(const Room *room, int chunk, uint8_t *bits);
+
+// Overwrite chunk <chunk> from a bitmap, e.g. when restoring a saved room.
+// Updates its hash and dirty flag but not version or terrain_version.
+void room_load_chunk(Room *room, int chunk, const uint8_t *bits);
+
+// Slot of the active player at (row, col), or -1.
+int room_player_at(const Room *room, int row, int col);
+
+// Apply one command. events may be NULL.
+RoomResult room_apply(Room *room, const Cmd *cmd, EventList *events);
+
+// Close the current tick: remember every player's position so a later
+// ATTACK can be resolved as of this tick, then advance room->tick.
+void room_end_tick(Room *room);
+
+// Every event is also appended to the room's own log with a sequence
+// number, whatever the caller passed as events. Move up to max of them,
+// oldest first, into out and return how many were taken. Events emitted
+// while the log is full are dropped, which shows up as a gap in seq.
+int room_take_events(Room *room, Event *out, int max);
+
+static inline char room_symbol(int slot) { return 'A' + slot; }
+
+// Render a state frame (grid + player info) for arbitrary slots and cells,
+// so replay playback produces exactly the frames a live room does.
+int game_format_state(char *out, size_t cap, int grid_size, const int *cells,
+                      const Player *players, int slots);
+// Upper bound on the frame size for a grid and slot count.
+size_t game_state_cap(int grid_size, int slots);
+int room_serialize(const Room *room, char *out, size_t cap);
+
+// Render single sections of the state frame for channel subscribers:
+// "Grid:" (the map with player symbols), "Positions:" ("A: (r,c)" lines) and
+// "HP:" ("A: 100" lines). Each fits in game_state_cap() bytes.
+int room_format_grid(const Room *room, char *out, size_t cap);
+int room_format_positions(const Room *room, char *out, size_t cap);
+int room_format_hp(const Room *room, char *out, size_t cap);
+
+#endif
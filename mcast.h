@@ -0,0 +1,50 @@
+/*
+ * Wire format of the UDP multicast spectator feed.
+ *
+ * The server sends one datagram per state change to a multicast group, so a
+ * single send reaches every screen on the segment. Each datagram is
+ *
+ *   McastHeader                        magic, sequence number, room version
+ *   McastPlayer players[count]         keyframe: every slot; delta: changed slots
+ *   uint8_t obstacles[(grid^2 + 7)/8]  keyframe only: map bits, row-major, LSB first
+ *
+ * A keyframe carries the whole state and is sent at least every
+ * MCAST_KEYFRAME_MS and every MCAST_KEYFRAME_EVERY datagrams; a delta carries
+ * only the slots that changed since the previous datagram. Receivers that
+ * see a gap in seq (UDP may drop or reorder) ignore deltas until the next
+ * keyframe. Integers are in host byte order, as in replay files.
+ *
+ * Grids whose keyframe would exceed MCAST_MAX_DATAGRAM are not multicast.
+ */
+#ifndef MCAST_H
+#define MCAST_H
+
+#include <stdint.h>
+
+#define MCAST_MAGIC "ABGM"
+#define MCAST_KEYFRAME 'K'
+#define MCAST_DELTA 'D'
+#define MCAST_KEYFRAME_MS 1000
+#define MCAST_KEYFRAME_EVERY 32
+#define MCAST_MAX_DATAGRAM 65000
+#define MCAST_MAX_SLOTS 255
+
+typedef struct {
+    char magic[4];
+    uint32_t seq;             // +1 per datagram
+    uint64_t version;         // room version after applying this datagram
+    uint16_t grid_size;
+    uint8_t kind;             // MCAST_KEYFRAME or MCAST_DELTA
+    uint8_t max_players;
+    uint16_t count;           // McastPlayer entries that follow
+    uint16_t reserved;
+} McastHeader;
+
+typedef struct {
+    uint16_t row, col;
+    int16_t hp;
+    uint8_t slot;
+    uint8_t active;
+} McastPlayer;
+
+#endif
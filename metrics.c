@@ -0,0 +1,54 @@
+/*
+ * Metrics registry. Registration takes a lock; updates and reads do not.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "metrics.h"
+
+static Metric registry[METRICS_MAX];
+static atomic_int registry_count = 0;
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+Metric *metric_register(const char *name, MetricKind kind) {
+    pthread_mutex_lock(&registry_lock);
+    int n = atomic_load(&registry_count);
+    for (int i = 0; i < n; ++i) {
+        if (strcmp(registry[i].name, name) == 0) {
+            pthread_mutex_unlock(&registry_lock);
+            return &registry[i];
+        }
+    }
+    Metric *m = NULL;
+    if (n < METRICS_MAX) {
+        m = &registry[n];
+        m->name = name;
+        m->kind = kind;
+        atomic_init(&m->value, 0);
+        // Publish only after the slot is fully initialized
+        atomic_store(&registry_count, n + 1);
+    }
+    pthread_mutex_unlock(&registry_lock);
+    return m;
+}
+
+int metrics_format(char *out, size_t cap) {
+    int offset = 0;
+    int n = atomic_load(&registry_count);
+    for (int i = 0; i < n && (size_t)offset < cap; ++i) {
+        offset += snprintf(out + offset, cap - offset, "%s %ld\n",
+                           registry[i].name, metric_get(&registry[i]));
+    }
+    return (size_t)offset < cap ? offset : (int)cap - 1;
+}
+
+int metrics_snapshot(const char **names, MetricKind *kinds, long *values, int max) {
+    int n = atomic_load(&registry_count);
+    if (n > max) n = max;
+    for (int i = 0; i < n; ++i) {
+        names[i] = registry[i].name;
+        kinds[i] = registry[i].kind;
+        values[i] = metric_get(&registry[i]);
+    }
+    return n;
+}
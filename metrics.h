@@ -0,0 +1,45 @@
+/*
+ * Minimal process-wide metrics registry.
+ * Metrics are registered once by name and updated lock-free from any thread.
+ * The STATS command renders the registry as "name value" lines.
+ */
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+#define METRICS_MAX 64
+
+typedef enum { METRIC_COUNTER, METRIC_GAUGE } MetricKind;
+
+typedef struct {
+    const char *name;
+    MetricKind kind;
+    atomic_long value;
+} Metric;
+
+// Returns the metric registered under name, creating it on first use.
+// Returns NULL once METRICS_MAX metrics exist.
+Metric *metric_register(const char *name, MetricKind kind);
+
+static inline void metric_add(Metric *m, long delta) {
+    if (m) atomic_fetch_add_explicit(&m->value, delta, memory_order_relaxed);
+}
+
+static inline void metric_set(Metric *m, long value) {
+    if (m) atomic_store_explicit(&m->value, value, memory_order_relaxed);
+}
+
+static inline long metric_get(Metric *m) {
+    return m ? atomic_load_explicit(&m->value, memory_order_relaxed) : 0;
+}
+
+// Render every metric as "name value\n" into out; returns bytes written.
+int metrics_format(char *out, size_t cap);
+
+// Copy up to max registered metrics, in registration order (a metric's
+// index never changes), into the arrays; returns how many were copied.
+int metrics_snapshot(const char **names, MetricKind *kinds, long *values, int max);
+
+#endif
@@ -0,0 +1,131 @@
+/*
+ * metrics_csv: print a time range of recorded metrics (see metrics_log.h) as
+ * CSV. Columns are the union of the metric names in the given files, in
+ * order of first appearance; a metric missing from a file is left empty.
+ *
+ * Compile:
+ *   gcc -Wall -Wextra -O2 metrics_csv.c -o metrics_csv
+ *
+ * Usage:
+ *   ./metrics_csv [-f <from>] [-t <to>] metrics/metrics-*.bin > out.csv
+ *   (from and to are Unix times in seconds; both ends are inclusive)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "metrics_log.h"
+
+#define MAX_COLUMNS 1024
+
+static char columns[MAX_COLUMNS][METRICS_LOG_NAME_LEN + 1];
+static int column_count = 0;
+
+static int column_of(const char *name) {
+    for (int c = 0; c < column_count; ++c) {
+        if (strcmp(columns[c], name) == 0) return c;
+    }
+    if (column_count == MAX_COLUMNS) return -1;
+    snprintf(columns[column_count], sizeof(columns[0]), "%s", name);
+    return column_count++;
+}
+
+typedef struct {
+    FILE *fp;
+    MetricsLogHeader header;
+    int *column;             // metric id -> CSV column, -1 = unnamed
+} LogFile;
+
+static int open_log(const char *path, LogFile *log) {
+    log->fp = fopen(path, "rb");
+    if (!log->fp) {
+        perror(path);
+        return -1;
+    }
+    MetricsLogHeader *h = &log->header;
+    if (fread(h, sizeof(*h), 1, log->fp) != 1 || memcmp(h->magic, METRICS_LOG_MAGIC, 8) != 0 ||
+        h->record_size != sizeof(MetricsLogRecord) + h->slots * sizeof(int64_t)) {
+        fprintf(stderr, "%s: not a metrics log\n", path);
+        fclose(log->fp);
+        return -1;
+    }
+    log->column = malloc(h->slots * sizeof(int));
+    for (uint32_t i = 0; i < h->slots; ++i) {
+        MetricsLogName entry;
+        if (fread(&entry, sizeof(entry), 1, log->fp) != 1) {
+            fprintf(stderr, "%s: truncated name table\n", path);
+            fclose(log->fp);
+            return -1;
+        }
+        entry.name[METRICS_LOG_NAME_LEN - 1] = '\0';
+        log->column[i] = entry.name[0] ? column_of(entry.name) : -1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    long long from = 0, to = -1;
+    int opt;
+    while ((opt = getopt(argc, argv, "f:t:")) != -1) {
+        switch (opt) {
+        case 'f':
+            from = atoll(optarg);
+            break;
+        case 't':
+            to = atoll(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-f from] [-t to] <metrics-file>...\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    int files = argc - optind;
+    if (files < 1) {
+        fprintf(stderr, "Usage: %s [-f from] [-t to] <metrics-file>...\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    // Read every name table first so the header lists all columns
+    LogFile *logs = calloc(files, sizeof(LogFile));
+    for (int i = 0; i < files; ++i) {
+        if (open_log(argv[optind + i], &logs[i]) < 0) logs[i].fp = NULL;
+    }
+    printf("time");
+    for (int c = 0; c < column_count; ++c) printf(",%s", columns[c]);
+    printf("\n");
+
+    long long *row = malloc(MAX_COLUMNS * sizeof(long long));
+    char *present = malloc(MAX_COLUMNS);
+    for (int i = 0; i < files; ++i) {
+        LogFile *log = &logs[i];
+        if (!log->fp) continue;
+        MetricsLogRecord *rec = malloc(log->header.record_size);
+        // A torn last record fails the fread and ends the file
+        while (fread(rec, log->header.record_size, 1, log->fp) == 1) {
+            long long seconds = rec->time_ms / 1000;
+            if (seconds < from || (to >= 0 && seconds > to)) continue;
+            memset(present, 0, MAX_COLUMNS);
+            for (uint32_t id = 0; id < log->header.slots; ++id) {
+                int c = log->column[id];
+                if (c < 0) continue;
+                row[c] = rec->values[id];
+                present[c] = 1;
+            }
+            printf("%lld.%03lld", seconds, (long long)(rec->time_ms % 1000));
+            for (int c = 0; c < column_count; ++c) {
+                if (present[c]) {
+                    printf(",%lld", row[c]);
+                } else {
+                    printf(",");
+                }
+            }
+            printf("\n");
+        }
+        free(rec);
+        fclose(log->fp);
+        free(log->column);
+    }
+    free(row);
+    free(present);
+    free(logs);
+    return 0;
+}
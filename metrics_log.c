@@ -0,0 +1,144 @@
+/*
+ * Metrics time-series recorder. See metrics_log.h for the file format.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "metrics_log.h"
+
+typedef struct {
+    char dir[256];
+    int fd;
+    long offset;             // end of the last complete record
+    int named;               // name slots already written to this file
+} Recorder;
+
+static int64_t unix_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Delete all but the newest METRICS_LOG_KEEP_FILES files. Names carry a
+// zero-padded timestamp, so name order is age order.
+static void prune(const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d) return;
+    char *names[1024];
+    int n = 0;
+    struct dirent *e;
+    while ((e = readdir(d)) && n < 1024) {
+        if (strncmp(e->d_name, "metrics-", 8) == 0 && strstr(e->d_name, ".bin")) {
+            names[n++] = strdup(e->d_name);
+        }
+    }
+    closedir(d);
+    qsort(names, n, sizeof(char *), compare_names);
+    for (int i = 0; i < n; ++i) {
+        if (i < n - METRICS_LOG_KEEP_FILES) {
+            char path[512];
+            snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+            unlink(path);
+        }
+        free(names[i]);
+    }
+}
+
+// Close the current file and start a new one with an empty name table.
+static int rotate(Recorder *r) {
+    if (r->fd >= 0) close(r->fd);
+    MetricsLogHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, METRICS_LOG_MAGIC, 8);
+    h.slots = METRICS_MAX;
+    h.record_size = sizeof(MetricsLogRecord) + METRICS_MAX * sizeof(int64_t);
+    h.created_ms = unix_ms();
+    h.interval_ms = METRICS_LOG_INTERVAL_MS;
+    char path[512];
+    snprintf(path, sizeof(path), "%s/metrics-%010lld.bin", r->dir, (long long)(h.created_ms / 1000));
+    r->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (r->fd < 0) {
+        perror("Metrics log: open");
+        return -1;
+    }
+    static const MetricsLogName empty[METRICS_MAX];
+    if (write(r->fd, &h, sizeof(h)) != sizeof(h) || write(r->fd, empty, sizeof(empty)) != sizeof(empty)) {
+        perror("Metrics log: write");
+        close(r->fd);
+        r->fd = -1;
+        return -1;
+    }
+    r->offset = sizeof(h) + sizeof(empty);
+    r->named = 0;
+    prune(r->dir);
+    return 0;
+}
+
+static void *recorder_thread(void *arg) {
+    Recorder *r = arg;
+    size_t record_size = sizeof(MetricsLogRecord) + METRICS_MAX * sizeof(int64_t);
+    MetricsLogRecord *rec = calloc(1, record_size);
+    const char *names[METRICS_MAX];
+    MetricKind kinds[METRICS_MAX];
+    long values[METRICS_MAX];
+    while (rec) {
+        // Sleep to the next interval boundary so records line up across files
+        int64_t now = unix_ms();
+        long wait = METRICS_LOG_INTERVAL_MS - now % METRICS_LOG_INTERVAL_MS;
+        struct timespec period = { wait / 1000, (wait % 1000) * 1000000L };
+        nanosleep(&period, NULL);
+
+        if ((r->fd < 0 || r->offset >= METRICS_LOG_FILE_BYTES) && rotate(r) < 0) continue;
+        int n = metrics_snapshot(names, kinds, values, METRICS_MAX);
+        // Name slots are written in place the first time a metric shows up
+        for (int i = r->named; i < n; ++i) {
+            MetricsLogName entry;
+            memset(&entry, 0, sizeof(entry));
+            snprintf(entry.name, sizeof(entry.name), "%s", names[i]);
+            entry.kind = kinds[i];
+            pwrite(r->fd, &entry, sizeof(entry), sizeof(MetricsLogHeader) + i * sizeof(entry));
+        }
+        r->named = n;
+        rec->time_ms = unix_ms();
+        for (int i = 0; i < METRICS_MAX; ++i) rec->values[i] = i < n ? values[i] : 0;
+        if (pwrite(r->fd, rec, record_size, r->offset) == (ssize_t)record_size) {
+            r->offset += record_size;
+        } else {
+            // Disk full or similar: try a fresh file next time
+            perror("Metrics log: write");
+            close(r->fd);
+            r->fd = -1;
+        }
+    }
+    return NULL;
+}
+
+int metrics_log_start(const char *dir) {
+    Recorder *r = calloc(1, sizeof(*r));
+    if (!r) return -1;
+    snprintf(r->dir, sizeof(r->dir), "%s", dir);
+    r->fd = -1;
+    if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+        perror("Metrics log: mkdir");
+        free(r);
+        return -1;
+    }
+    pthread_t thread_id;
+    if (pthread_create(&thread_id, NULL, recorder_thread, r) != 0) {
+        free(r);
+        return -1;
+    }
+    pthread_detach(thread_id);
+    return 0;
+}
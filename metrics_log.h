@@ -0,0 +1,57 @@
+/*
+ * On-disk metrics time series.
+ *
+ * The server snapshots the whole metrics registry once per
+ * METRICS_LOG_INTERVAL_MS into an append-only file of fixed-size records, so
+ * there is a history to look at even when nobody was scraping STATS. Layout
+ * (integers in host byte order, like replay files):
+ *
+ *   MetricsLogHeader                   magic, slot count, record size
+ *   MetricsLogName names[slots]        metric id -> name; filled in place as
+ *                                      metrics are registered
+ *   MetricsLogRecord records...        one per interval: time + every value
+ *
+ * A metric's id is its registry index, so a column never changes meaning
+ * within a file. Unregistered slots record 0. A crash can leave a torn last
+ * record; readers ignore a trailing partial record.
+ *
+ * Files are named <dir>/metrics-<unix seconds>.bin. A new file is started
+ * once the current one reaches METRICS_LOG_FILE_BYTES, and only the newest
+ * METRICS_LOG_KEEP_FILES are kept. metrics_csv turns a time range into CSV.
+ */
+#ifndef METRICS_LOG_H
+#define METRICS_LOG_H
+
+#include <stdint.h>
+#include "metrics.h"
+
+#define METRICS_LOG_MAGIC "ABGMET01"
+#define METRICS_LOG_INTERVAL_MS 1000
+#define METRICS_LOG_FILE_BYTES (16L << 20)   // about 9 hours per file
+#define METRICS_LOG_KEEP_FILES 8
+#define METRICS_LOG_NAME_LEN 47
+
+typedef struct {
+    char magic[8];
+    uint32_t slots;          // values per record (METRICS_MAX when written)
+    uint32_t record_size;    // sizeof(MetricsLogRecord) for <slots>
+    int64_t created_ms;      // Unix time the file was started
+    uint32_t interval_ms;
+    uint32_t reserved;
+} MetricsLogHeader;
+
+typedef struct {
+    char name[METRICS_LOG_NAME_LEN];   // "" = slot not registered yet
+    uint8_t kind;                      // MetricKind
+} MetricsLogName;
+
+typedef struct {
+    int64_t time_ms;         // Unix time of the snapshot
+    int64_t values[];        // <slots> entries, indexed by metric id
+} MetricsLogRecord;
+
+// Start the recorder thread writing into <dir> (created if missing).
+// Returns 0 on success, -1 if the thread could not be started.
+int metrics_log_start(const char *dir);
+
+#endif
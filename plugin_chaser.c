@@ -0,0 +1,63 @@
+/*
+ * Example bot plugin: walk toward the nearest living opponent and attack
+ * once adjacent. Moves that would hit an obstacle try the other axis.
+ *
+ * Build and run:
+ *   gcc -Wall -Wextra -O2 -shared -fPIC plugin_chaser.c -o chaser.so
+ *   ./client --bots ./chaser.so 3 127.0.0.1 12345
+ */
+#include <stdlib.h>
+#include "bot_sdk.h"
+
+static int free_cell(const BotState *s, int row, int col) {
+    if (row < 0 || col < 0 || row >= s->grid_size || col >= s->grid_size) return 0;
+    if (bot_cell(s, row, col) == 'X') return 0;
+    for (int p = 0; p < BOT_MAX_SLOTS; ++p) {
+        if (s->players[p].active && s->players[p].row == row && s->players[p].col == col) return 0;
+    }
+    return 1;
+}
+
+static int chaser_on_frame(void *bot, const BotState *s, BotCommand *out) {
+    (void) bot;
+    const BotPlayer *me = &s->players[s->self];
+    if (!me->active) return 0;
+    int target = -1, best = 0;
+    for (int p = 0; p < BOT_MAX_SLOTS; ++p) {
+        if (p == s->self || !s->players[p].active) continue;
+        int d = abs(s->players[p].row - me->row) + abs(s->players[p].col - me->col);
+        if (target < 0 || d < best) {
+            target = p;
+            best = d;
+        }
+    }
+    if (target < 0) return 0;
+    if (best == 1) {
+        out->type = BOT_ATTACK;
+        return 1;
+    }
+    int dr = s->players[target].row - me->row, dc = s->players[target].col - me->col;
+    int vertical = dr > 0 ? BOT_DOWN : BOT_UP, horizontal = dc > 0 ? BOT_RIGHT : BOT_LEFT;
+    int step_r = dr > 0 ? 1 : -1, step_c = dc > 0 ? 1 : -1;
+    out->type = BOT_MOVE;
+    if (dr != 0 && free_cell(s, me->row + step_r, me->col)) {
+        out->dir = vertical;
+    } else if (dc != 0 && free_cell(s, me->row, me->col + step_c)) {
+        out->dir = horizontal;
+    } else {
+        out->dir = rand() % 4;   // boxed in on the direct path, wander
+    }
+    return 1;
+}
+
+static const BotPlugin chaser = {
+    .abi = BOT_SDK_ABI,
+    .name = "chaser",
+    .create = NULL,
+    .on_frame = chaser_on_frame,
+    .destroy = NULL,
+};
+
+const BotPlugin *bot_plugin_entry(void) {
+    return &chaser;
+}
@@ -0,0 +1,234 @@
+/*
+ * Replay writer and mmap-based reader. See replay.h for the file layout.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "replay.h"
+
+struct ReplayWriter {
+    FILE *fp;
+    char path[256];
+    uint64_t offset;              // current end of file
+    int max_players;
+    uint32_t tick_count;
+    struct timespec started;
+    ReplayPlayer prev[REPLAY_MAX_SLOTS];
+    ReplayIndexEntry *index;
+    uint32_t index_count, index_cap;
+};
+
+// -------- Writer --------
+static int write_bytes(ReplayWriter *w, const void *data, size_t len) {
+    if (fwrite(data, 1, len, w->fp) != len) return -1;
+    w->offset += len;
+    return 0;
+}
+
+ReplayWriter *replay_begin(const char *path, uint32_t seed, int grid_size,
+                           const int *obstacles, int max_players) {
+    if (max_players <= 0 || max_players > REPLAY_MAX_SLOTS) return NULL;
+    ReplayWriter *w = calloc(1, sizeof(*w));
+    if (!w) return NULL;
+    snprintf(w->path, sizeof(w->path), "%s", path);
+    char tmp[300];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    w->fp = fopen(tmp, "wb");
+    if (!w->fp) {
+        free(w);
+        return NULL;
+    }
+    w->max_players = max_players;
+    clock_gettime(CLOCK_MONOTONIC, &w->started);
+
+    ReplayHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, REPLAY_MAGIC, sizeof(h.magic));
+    h.seed = seed;
+    h.grid_size = grid_size;
+    h.max_players = max_players;
+    h.keyframe_interval = REPLAY_KEYFRAME_INTERVAL;
+    int err = write_bytes(w, &h, sizeof(h));
+    for (int i = 0; i < grid_size * grid_size && !err; ++i) {
+        uint8_t cell = obstacles[i] ? 1 : 0;
+        err = write_bytes(w, &cell, 1);
+    }
+    if (err) {
+        fclose(w->fp);
+        unlink(tmp);
+        free(w);
+        return NULL;
+    }
+    return w;
+}
+
+int replay_record(ReplayWriter *w, const ReplayPlayer *players) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ReplayRecordHeader rh;
+    memset(&rh, 0, sizeof(rh));
+    rh.tick = w->tick_count;
+    rh.time_ms = (now.tv_sec - w->started.tv_sec) * 1000 +
+                 (now.tv_nsec - w->started.tv_nsec) / 1000000;
+
+    // Collect the slots to write: all of them on a keyframe, otherwise only
+    // those that differ from the previous tick.
+    ReplayPlayer changed[REPLAY_MAX_SLOTS];
+    int n = 0;
+    int keyframe = (w->tick_count % REPLAY_KEYFRAME_INTERVAL) == 0;
+    for (int i = 0; i < w->max_players; ++i) {
+        if (keyframe || memcmp(&players[i], &w->prev[i], sizeof(ReplayPlayer)) != 0) {
+            changed[n++] = players[i];
+        }
+    }
+    rh.kind = keyframe ? REPLAY_RECORD_KEYFRAME : REPLAY_RECORD_DELTA;
+    rh.count = n;
+
+    if (keyframe) {
+        if (w->index_count == w->index_cap) {
+            uint32_t cap = w->index_cap ? w->index_cap * 2 : 64;
+            ReplayIndexEntry *grown = realloc(w->index, cap * sizeof(*grown));
+            if (!grown) return -1;
+            w->index = grown;
+            w->index_cap = cap;
+        }
+        ReplayIndexEntry *e = &w->index[w->index_count++];
+        memset(e, 0, sizeof(*e));
+        e->tick = rh.tick;
+        e->offset = w->offset;
+    }
+    if (write_bytes(w, &rh, sizeof(rh)) < 0 ||
+        write_bytes(w, changed, n * sizeof(ReplayPlayer)) < 0) {
+        return -1;
+    }
+    memcpy(w->prev, players, w->max_players * sizeof(ReplayPlayer));
+    w->tick_count++;
+    return 0;
+}
+
+int replay_finish(ReplayWriter *w) {
+    ReplayTrailer t;
+    memset(&t, 0, sizeof(t));
+    t.index_offset = w->offset;
+    t.index_count = w->index_count;
+    t.tick_count = w->tick_count;
+    memcpy(t.magic, REPLAY_TRAILER_MAGIC, sizeof(t.magic));
+    int err = write_bytes(w, w->index, w->index_count * sizeof(ReplayIndexEntry));
+    if (!err) err = write_bytes(w, &t, sizeof(t));
+    if (fclose(w->fp) != 0) err = -1;
+
+    char tmp[300];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", w->path);
+    if (!err && rename(tmp, w->path) < 0) err = -1;
+    if (err) unlink(tmp);
+    free(w->index);
+    free(w);
+    return err;
+}
+
+void replay_abort(ReplayWriter *w) {
+    fclose(w->fp);
+    char tmp[300];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", w->path);
+    unlink(tmp);
+    free(w->index);
+    free(w);
+}
+
+// -------- Reader --------
+int replay_open(ReplayReader *r, const char *path) {
+    memset(r, 0, sizeof(*r));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)(sizeof(ReplayHeader) + sizeof(ReplayTrailer))) {
+        close(fd);
+        return -1;
+    }
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return -1;
+    r->base = base;
+    r->size = st.st_size;
+
+    // Validate header and trailer before trusting any offsets in them
+    ReplayTrailer t;
+    memcpy(&r->header, r->base, sizeof(r->header));
+    memcpy(&t, r->base + r->size - sizeof(t), sizeof(t));
+    uint64_t grid_bytes = (uint64_t)r->header.grid_size * r->header.grid_size;
+    r->records_offset = sizeof(ReplayHeader) + grid_bytes;
+    if (memcmp(r->header.magic, REPLAY_MAGIC, 8) != 0 ||
+        memcmp(t.magic, REPLAY_TRAILER_MAGIC, 8) != 0 ||
+        r->header.max_players == 0 || r->header.max_players > REPLAY_MAX_SLOTS ||
+        t.index_offset < r->records_offset ||
+        t.index_offset + (uint64_t)t.index_count * sizeof(ReplayIndexEntry) + sizeof(t) != r->size) {
+        replay_close(r);
+        return -1;
+    }
+    r->obstacles = r->base + sizeof(ReplayHeader);
+    r->index = (const ReplayIndexEntry *)(r->base + t.index_offset);
+    r->index_count = t.index_count;
+    r->tick_count = t.tick_count;
+    r->records_end = t.index_offset;
+    return 0;
+}
+
+void replay_close(ReplayReader *r) {
+    if (r->base) munmap((void *)r->base, r->size);
+    memset(r, 0, sizeof(*r));
+}
+
+ReplayIndexEntry replay_index_at(const ReplayReader *r, uint32_t i) {
+    ReplayIndexEntry e;
+    memcpy(&e, (const uint8_t *)r->index + (size_t)i * sizeof(e), sizeof(e));
+    return e;
+}
+
+// Decode the record at cur->offset into the cursor.
+static int apply_record(const ReplayReader *r, ReplayCursor *cur) {
+    ReplayRecordHeader rh;
+    if (cur->offset + sizeof(rh) > r->records_end) return -1;
+    memcpy(&rh, r->base + cur->offset, sizeof(rh));
+    uint64_t body = cur->offset + sizeof(rh);
+    if (body + (uint64_t)rh.count * sizeof(ReplayPlayer) > r->records_end) return -1;
+    if (rh.kind == REPLAY_RECORD_KEYFRAME) {
+        memset(cur->players, 0, sizeof(cur->players));
+    }
+    for (int i = 0; i < rh.count; ++i) {
+        ReplayPlayer p;
+        memcpy(&p, r->base + body + i * sizeof(p), sizeof(p));
+        if (p.slot < r->header.max_players) cur->players[p.slot] = p;
+    }
+    cur->tick = rh.tick;
+    cur->time_ms = rh.time_ms;
+    cur->offset = body + (uint64_t)rh.count * sizeof(ReplayPlayer);
+    return 0;
+}
+
+int replay_seek(const ReplayReader *r, ReplayCursor *cur, uint32_t tick) {
+    if (r->index_count == 0) return -1;
+    if (tick >= r->tick_count) tick = r->tick_count - 1;
+    // Binary search for the last keyframe with index tick <= target
+    uint32_t lo = 0, hi = r->index_count;
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (replay_index_at(r, mid).tick <= tick) lo = mid;
+        else hi = mid;
+    }
+    cur->offset = replay_index_at(r, lo).offset;
+    if (apply_record(r, cur) < 0) return -1;
+    while (cur->tick < tick) {
+        if (apply_record(r, cur) < 0) return -1;
+    }
+    return 0;
+}
+
+int replay_next(const ReplayReader *r, ReplayCursor *cur) {
+    if (cur->offset >= r->records_end) return -1;
+    return apply_record(r, cur);
+}
@@ -0,0 +1,115 @@
+/*
+ * Replay file format for the ASCII Battle Game.
+ *
+ * A replay is written while a match is running and finalized when the match
+ * ends. Layout (all integers in host byte order, little-endian on our targets):
+ *
+ *   ReplayHeader                       magic, seed, grid and slot counts
+ *   uint8_t obstacles[grid * grid]     initial map, row-major, 1 = obstacle
+ *   records...                         one per tick: ReplayRecordHeader + entries
+ *   ReplayIndexEntry index[n]          one per keyframe, sorted by tick
+ *   ReplayTrailer                      where the index starts
+ *
+ * A keyframe record carries every player slot; a delta record carries only
+ * the slots that changed since the previous tick. A keyframe is written every
+ * REPLAY_KEYFRAME_INTERVAL ticks, so seeking to any tick costs one binary
+ * search over the index plus at most REPLAY_KEYFRAME_INTERVAL - 1 deltas.
+ */
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define REPLAY_MAGIC "ABGRPL01"
+#define REPLAY_TRAILER_MAGIC "ABGIDX01"
+#define REPLAY_KEYFRAME_INTERVAL 64
+#define REPLAY_MAX_SLOTS 255
+
+#define REPLAY_RECORD_KEYFRAME 'K'
+#define REPLAY_RECORD_DELTA 'D'
+
+typedef struct {
+    char magic[8];
+    uint32_t seed;           // srand() seed the match was created with
+    uint16_t grid_size;      // side of the square grid
+    uint16_t max_players;    // number of player slots in every keyframe
+    uint32_t keyframe_interval;
+    uint32_t reserved;
+} ReplayHeader;
+
+typedef struct {
+    uint16_t row, col;
+    int16_t hp;
+    uint8_t slot;            // index into players[]
+    uint8_t active;
+} ReplayPlayer;
+
+typedef struct {
+    uint32_t tick;
+    uint32_t time_ms;        // milliseconds since the match started
+    uint8_t kind;            // REPLAY_RECORD_KEYFRAME or REPLAY_RECORD_DELTA
+    uint8_t count;           // number of ReplayPlayer entries that follow
+    uint16_t reserved;
+} ReplayRecordHeader;
+
+typedef struct {
+    uint32_t tick;
+    uint32_t reserved;
+    uint64_t offset;         // file offset of the keyframe's ReplayRecordHeader
+} ReplayIndexEntry;
+
+typedef struct {
+    uint64_t index_offset;
+    uint32_t index_count;
+    uint32_t tick_count;
+    char magic[8];
+} ReplayTrailer;
+
+// -------- Writer --------
+typedef struct ReplayWriter ReplayWriter;
+
+// Create a replay at <path>.tmp; it is renamed to <path> by replay_finish().
+// obstacles points to grid_size * grid_size cells, row-major.
+ReplayWriter *replay_begin(const char *path, uint32_t seed, int grid_size,
+                           const int *obstacles, int max_players);
+// Append one tick. players holds max_players slots; only changed slots are
+// written unless a keyframe is due.
+int replay_record(ReplayWriter *w, const ReplayPlayer *players);
+// Write the keyframe index and trailer, close and publish the file.
+int replay_finish(ReplayWriter *w);
+// Give up on a replay after a failed write: close and delete the partial
+// file, which is never published.
+void replay_abort(ReplayWriter *w);
+
+// -------- Reader --------
+typedef struct {
+    const uint8_t *base;     // mmap'd file
+    size_t size;
+    ReplayHeader header;
+    const uint8_t *obstacles;
+    const ReplayIndexEntry *index; // may be unaligned; read through replay_index_at()
+    uint32_t index_count;
+    uint32_t tick_count;
+    uint64_t records_offset;
+    uint64_t records_end;
+} ReplayReader;
+
+// Cursor for sequential playback; holds the reconstructed state of every slot.
+typedef struct {
+    uint64_t offset;         // next record to decode
+    uint32_t tick;           // tick of the state currently in players[]
+    uint32_t time_ms;
+    ReplayPlayer players[REPLAY_MAX_SLOTS];
+} ReplayCursor;
+
+int replay_open(ReplayReader *r, const char *path);
+void replay_close(ReplayReader *r);
+ReplayIndexEntry replay_index_at(const ReplayReader *r, uint32_t i);
+// Position the cursor on <tick> (clamped to the last tick) by loading the
+// nearest keyframe at or before it and rolling deltas forward.
+int replay_seek(const ReplayReader *r, ReplayCursor *cur, uint32_t tick);
+// Advance the cursor by one tick. Returns 0 on success, -1 at end of replay.
+int replay_next(const ReplayReader *r, ReplayCursor *cur);
+
+#endif
@@ -0,0 +1,23 @@
+/*
+ * Loading rule modules from shared objects. See rules.h.
+ */
+#include <stdio.h>
+#include <dlfcn.h>
+#include "rules.h"
+
+const RuleModule *rules_load(const char *path, char *err, size_t errlen) {
+    void *library = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!library) {
+        snprintf(err, errlen, "cannot load %s: %s", path, dlerror());
+        return NULL;
+    }
+    const RuleModule *(*entry)(void) = (const RuleModule *(*)(void)) dlsym(library, RULES_ENTRY_SYMBOL);
+    const RuleModule *rules = entry ? entry() : NULL;
+    if (!rules || rules->abi != RULES_ABI || !rules->check_move || !rules->attack_damage ||
+        !rules->spawn_hp) {
+        snprintf(err, errlen, "%s is not a rule module for ABI %d", path, RULES_ABI);
+        dlclose(library);
+        return NULL;
+    }
+    return rules;
+}
@@ -0,0 +1,53 @@
+/*
+ * Rule modules: the game rules behind a function table.
+ *
+ * Every Room points at a RuleModule that decides whether a move is allowed,
+ * how much an attack deals and what HP a spawn starts with. The built-in
+ * classic rules are room_default_rules; others are loaded from a shared
+ * object exporting rules_module_entry(). The server swaps a room's module
+ * between ticks (under state_lock), so a new module takes over without
+ * dropping connections and no command ever sees two rule sets.
+ *
+ * Hooks get the Room itself, so a module is built against this game.h:
+ *   gcc -Wall -Wextra -O2 -shared -fPIC my_rules.c -o my_rules.so
+ * and may call room_player_at() or delegate to room_default_rules (the
+ * server links with -rdynamic to export them).
+ * RULES_ABI changes whenever Room or this table changes.
+ */
+#ifndef RULES_H
+#define RULES_H
+
+#include <stddef.h>
+#include "game.h"
+
+#define RULES_ABI 3
+#define RULES_ENTRY_SYMBOL "rules_module_entry"
+
+struct RuleModule {
+    int abi;                     // RULES_ABI
+    const char *name;
+    int version;                 // reported as the rules_version metric
+    // May <slot> step onto (row, col)? Return RES_OK or the reason it may not
+    // (RES_OUT_OF_BOUNDS, RES_OBSTACLE, RES_OCCUPIED).
+    RoomResult (*check_move)(const Room *room, int slot, int row, int col);
+    // Damage <attacker> deals to <target> standing dr rows and dc columns
+    // away (where the attacker saw it, for rewound attacks); 0 = out of reach.
+    int (*attack_damage)(const Room *room, int attacker, int target, int dr, int dc);
+    // Starting HP for a player spawning into <slot>.
+    int (*spawn_hp)(const Room *room, int slot);
+};
+
+// Classic rules: bounds, obstacles and players block moves; ATTACK hits the
+// four neighbours for params.damage; players spawn with params.max_hp.
+extern const RuleModule room_default_rules;
+
+// Exported by every rule module.
+const RuleModule *rules_module_entry(void);
+
+// Load the module in the shared object at <path> and check its ABI. The
+// object stays loaded for the life of the process, since rooms may still
+// point into it; load a new version from a new path. Returns NULL and
+// writes err on failure.
+const RuleModule *rules_load(const char *path, char *err, size_t errlen);
+
+#endif
@@ -0,0 +1,43 @@
+/*
+ * Example rule module: ATTACK reaches two cells in a straight line, dealing
+ * full damage next to the attacker and half damage one cell further out.
+ * Movement and spawning follow the classic rules.
+ *
+ * Build, then point the server at it and send SIGHUP:
+ *   gcc -Wall -Wextra -O2 -shared -fPIC rules_reach.c -o rules_reach.so
+ *   echo "rule_module = ./rules_reach.so" >> server.conf
+ */
+#include <stdlib.h>
+#include "rules.h"
+
+static RoomResult reach_check_move(const Room *room, int slot, int row, int col) {
+    return room_default_rules.check_move(room, slot, row, col);
+}
+
+static int reach_attack_damage(const Room *room, int attacker, int target, int dr, int dc) {
+    (void)attacker;
+    (void)target;
+    if (dr != 0 && dc != 0) return 0;
+    int distance = abs(dr) + abs(dc);
+    if (distance == 1) return room->params.damage;
+    if (distance == 2) return room->params.damage / 2;
+    return 0;
+}
+
+static int reach_spawn_hp(const Room *room, int slot) {
+    (void)slot;
+    return room->params.max_hp;
+}
+
+static const RuleModule reach = {
+    .abi = RULES_ABI,
+    .name = "reach",
+    .version = 1,
+    .check_move = reach_check_move,
+    .attack_damage = reach_attack_damage,
+    .spawn_hp = reach_spawn_hp,
+};
+
+const RuleModule *rules_module_entry(void) {
+    return &reach;
+}
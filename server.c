@@ -1,8 +1,28 @@
 /*
  * TCP-based ASCII Battle Game Server
  * This server accepts up to 4 clients and manages a 5x5 grid with obstacles and players.
- * Each client is handled in a separate thread and can send commands: MOVE, ATTACK, QUIT.
+ * Each client is served by a thread from a pre-spawned worker pool and can send commands: MOVE, ATTACK, QUIT.
  * The server broadcasts the game state (grid + player info) to all clients after each valid action.
+ * Every match (from the first join until the grid is empty again) is recorded to replays/.
+ * The metrics registry is snapshotted every second into metrics/ (metrics_log.h).
+ * With -C the world is persistent: it is checkpointed incrementally and picked
+ * up again after a restart (checkpoint.h).
+ * Optional server-side bots fill free slots while at least one human is playing.
+ * The rules themselves live in the I/O-free game core (game.c); this file is the
+ * network front end that turns its result codes and events into messages.
+ * Terrain subscribers get the map as content-addressed chunks (terrain.h).
+ * The rules can be swapped for a module loaded from a shared object (rules.h).
+ *
+ * Compile:
+ *   gcc server.c game.c rules.c config.c replay.c bot.c metrics.c metrics_log.c fanout.c checkpoint.c -o server -pthread -ldl -rdynamic
+ *
+ * Usage:
+ *   ./server [-c config-file] [-b bots] [-f fanout-threads] [-C checkpoint-log] <port>
+ *   ./server -m 239.1.2.3:5000 [-I 127.0.0.1] <port>
+ *   (also multicast the live match for LAN screens; see mcast.h)
+ *   (send SIGHUP to re-read the config file without restarting)
+ *   ./server -B <bots>        (benchmark the bot decision kernels and exit)
+ *   ./server -H <seconds>     (headless game-logic benchmark without sockets)
  */
 #include <stdio.h>
 #include <stdlib.h>
@@ -15,101 +35,1753 @@
 #include <time.h>
 #include <errno.h>
 #include <ctype.h>
+#include <sys/stat.h>
+#include <sys/random.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include "game.h"
+#include "config.h"
+#include "replay.h"
+#include "bot.h"
+#include "metrics.h"
+#include "metrics_log.h"
+#include "fanout.h"
+#include "mcast.h"
+#include "rules.h"
+#include "checkpoint.h"
 
-// Constants for game configuration
-#define GRID_SIZE 5
-#define MAX_PLAYERS 4
-#define MAX_HP 100
-#define DAMAGE 20
+// Constants for server configuration
+#define REPLAY_DIR "replays"
+#define METRICS_DIR "metrics"      // recorded metrics time series (metrics_log.h)
+#define MAX_SPECTATORS 65536
+#define SESSION_TOKEN_LEN CHECKPOINT_TOKEN_LEN   // tokens survive a checkpoint restore
+#define HISTORY_LEN 128
+#define MAX_CHANNEL_SPECTATORS 1024   // spectators with a SUBSCRIBE (sent inline)
+#define LISTEN_BACKLOG 1024
+#define ACCEPT_BATCH 256         // most connections admitted per join batch
+#define WORKERS_PRESPAWN 16      // idle client workers kept ready
+#define WORK_QUEUE_LEN 1024
+#define IDLE_AFTER_TICKS 8       // quiet ticks before a room drops to its heartbeat
+#define TICK_BUSY_PERCENT 50     // tick cost above this share of the period backs off
+#define CPU_HEADROOM_MIN 10      // percent of host CPU left below which ticks back off
+#define COMMANDS_WAITING_MAX 32  // commands queued on state_lock before ticks back off
+#define OVERLOAD_CALM_TICKS 8    // calm ticks before the overload level steps down
+#define SHED_SPECTATOR_MS 500    // spectator frame interval while shedding
+#define DEFERRED_JOIN_BATCH 8    // joins admitted per DEFERRED_JOIN_MS while deferring
+#define DEFERRED_JOIN_MS 250
+#define FANOUT_BALANCE_MS 1000   // how often spectator sockets are rebalanced
+#define CHAT_MAX_LEN 200         // longest SAY / TEAM message
+#define CHAT_BATCH_MAX 8192      // chat bytes per channel per tick
+#define TERRAIN_VIEW_CHUNKS 1    // a player sees terrain chunks this far from its own
 
-// Structure to hold player info
 // -------- Data Structures and Global Variables --------
+// Global game state
+Room *room = NULL;
+int conn_fd[ROOM_MAX_PLAYERS];   // socket per player slot, -1 for bots and free slots
+
+// Replay of the match in progress. Broadcasts only queue their snapshot in
+// replay_pending (under state_lock); the tick thread swaps the queue with
+// replay_writing and writes it after releasing the lock, so replay file I/O
+// never holds up the room.
 typedef struct {
-    char symbol;       // Unique symbol representing the player (e.g., 'A', 'B', 'C', 'D')
-    int row, col;      // Current position on the grid
-    int hp;            // Hit points
-    int socket_fd;     // Socket file descriptor for the player's connection
-    int active;        // Whether this player slot is active (1) or free (0)
-} Player;
+    ReplayPlayer snap[ROOM_MAX_PLAYERS];
+    int *obstacles;              // non-NULL: open a new replay with this map first
+    char path[128];
+    uint32_t seed;
+    int grid_size, max_players;
+    int finish;                  // finalize the replay after this tick
+} ReplayTick;
+typedef struct {
+    ReplayTick *ticks;
+    int count, cap;
+} ReplayQueue;
+ReplayQueue replay_pending;      // guarded by state_lock
+ReplayQueue replay_writing;      // tick thread only
+int replay_recording = 0;        // a match is being queued (state_lock)
+ReplayWriter *replay = NULL;     // tick thread only; NULL while no file is open
+unsigned int match_seq = 0;
 
-// Global game state
-Player players[MAX_PLAYERS];
-int player_count = 0;
-int obstacles[GRID_SIZE][GRID_SIZE]; // 0 for empty, 1 for obstacle
+// Checkpoint log of a persistent world (-C), NULL when the world is not kept
+const char *checkpoint_path = NULL;
+
+// Resumable sessions: when a connection drops without QUIT the player stays
+// on the board, detached, for resume_grace_ms so the client can RESUME into
+// the same slot with its position and HP intact.
+char session_token[ROOM_MAX_PLAYERS][SESSION_TOKEN_LEN + 1];
+int detached[ROOM_MAX_PLAYERS];
+struct timespec detached_at[ROOM_MAX_PLAYERS];
+
+// Snapshots of recently broadcast versions, used to send a resuming client
+// only the slots that changed since the last version it saw.
+typedef struct {
+    unsigned long version;
+    ReplayPlayer snap[ROOM_MAX_PLAYERS];
+} HistoryEntry;
+HistoryEntry history[HISTORY_LEN];
+unsigned long history_count = 0;
+
+// Live spectators (connections that sent WATCH without a replay id), spread
+// across fanout_threads I/O threads (0 = sent inline by the broadcaster)
+FanoutGroup *spectators = NULL;
+int fanout_threads = 0;
+
+// State channels a connection can SUBSCRIBE to instead of the full frame.
+// Snapshot channels (grid, positions, hp) are sent only when their text
+// changed, at most once per interval_ms; events go out once per room tick.
+// The terrain channel is per subscriber (it follows the view) and announces
+// content-addressed chunks instead of drawing the map (terrain.h).
+typedef enum { CH_GRID, CH_POSITIONS, CH_HP, CH_EVENTS, CH_TERRAIN, CH_COUNT } Channel;
+const char *CHANNEL_NAMES[CH_COUNT] = { "grid", "positions", "hp", "events", "terrain" };
+typedef struct {
+    int sockfd;                        // spectator subscribers only
+    unsigned mask;                     // 1 << Channel; 0 = classic full frame
+    int interval_ms[CH_COUNT];         // 0 = no rate limit
+    struct timespec last_sent[CH_COUNT];
+    unsigned long sent_seq[CH_COUNT];  // ChannelCache.seq last delivered
+    unsigned long terrain_version;     // room terrain_version announced, 0 = none
+    uint8_t terrain_seen[TERRAIN_MAX_CHUNKS / 8];   // chunks announced so far
+} Subscription;
+Subscription player_sub[ROOM_MAX_PLAYERS];
+Subscription spectator_subs[MAX_CHANNEL_SPECTATORS];
+int spectator_sub_count = 0;
+
+// Each channel is rendered once per state version and shared by every
+// subscriber; seq advances only when the rendered text actually changes.
+typedef struct {
+    char *text, *scratch;
+    size_t cap;
+    int len;
+    unsigned long version;             // room version the text was rendered for
+    unsigned long seq;
+} ChannelCache;
+ChannelCache channel_cache[CH_COUNT];
+Metric *m_chunks_announced, *m_chunks_sent;   // terrain channel, registered in main()
+Metric *m_events;                              // events channel, registered in main()
+
+// Chat posted during the current tick, one batch per channel: [0] is the
+// room channel, [1 + t] the channel of team t. Flushed once per tick.
+typedef struct {
+    char text[CHAT_BATCH_MAX];
+    int len;
+} ChatBatch;
+ChatBatch chat_batch[1 + ROOM_MAX_PLAYERS];
+
+// Multicast spectator feed (mcast_fd < 0 when disabled)
+int mcast_fd = -1;
+struct sockaddr_in mcast_addr;
+uint32_t mcast_seq = 0;
+int mcast_since_key = MCAST_KEYFRAME_EVERY;   // first datagram is a keyframe
+struct timespec mcast_last_key;
+ReplayPlayer mcast_prev[ROOM_MAX_PLAYERS];
+Metric *m_mcast_sent, *m_mcast_errors;   // registered by mcast_open()
 
 // Mutex for synchronizing access to game state
 pthread_mutex_t state_lock;
 
-// Helper function to send the current game state to all connected clients.
-// Assumes state_lock is already held by the caller.
+// Config file (NULL if none) and the command-line settings it is applied on
+const char *config_path = NULL;
+Config base_config;
+
+// Worker pool (see Worker Pool below); the queue depth also feeds the
+// overload level
+typedef struct {
+    int sockfd;
+    int slot;          // slot assigned on accept, -1 if the server was full
+} HandlerArgs;
+
+HandlerArgs work_queue[WORK_QUEUE_LEN];
+int work_head = 0, work_count = 0;
+int idle_workers = 0, total_workers = 0;
+pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t pool_cond = PTHREAD_COND_INITIALIZER;
+
+// Overload protection: each level sheds the work of the ones below it too.
+// Players' own commands are never shed; they do not wait for ticks.
+typedef enum {
+    LOAD_NORMAL,
+    LOAD_SHED_SPECTATORS,      // spectator frames at most every SHED_SPECTATOR_MS
+    LOAD_DEFER_JOINS,          // new joins wait in the listen backlog
+    LOAD_SLOW_TICKS,           // the room ticks at half its rate
+} LoadLevel;
+atomic_int overload_level;
+Metric *m_frames_shed, *m_overload_level, *m_tick_lag, *m_rss;   // registered in main()
+unsigned long spectator_version = 0;   // newest version sent to spectators
+struct timespec spectator_sent_at;
+
+// Adaptive tick rate: commands queued on state_lock and applied since the
+// last tick, and a condition a command signals to end an idle heartbeat.
+atomic_int commands_waiting;
+atomic_long commands_since_tick;
+atomic_int tick_idle;
+pthread_mutex_t tick_wake_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t tick_wake = PTHREAD_COND_INITIALIZER;
+Metric *m_headroom, *m_waiting, *m_tick_cost, *m_tick_adjust, *m_tick_period;   // registered in main()
+
+// Rule module the room should be running. A reload loads a changed
+// rule_module here, and the tick thread puts it into effect between ticks.
+_Atomic(const RuleModule *) next_rules = &room_default_rules;
+char rules_path[sizeof(((Config *)0)->rule_module)] = "";
+
 // -------- Helper Functions --------
-void broadcast_state_locked() {
-    char state_msg[512];
-    int offset = 0;
-    // Build grid representation
-    offset += snprintf(state_msg + offset, sizeof(state_msg) - offset, "Grid:\n");
-    for (int r = 0; r < GRID_SIZE; ++r) {
-        for (int c = 0; c < GRID_SIZE; ++c) {
-            char cell = '.'; // default empty cell
-            if (obstacles[r][c] == 1) {
-                cell = 'X'; // obstacle
+// Disconnect players the room removed (killed by an attack). The socket is
+// only shut down: the worker blocked in recv() on it sees the end of the
+// stream and does the one close(), so the fd number cannot be reused under it.
+// Assumes state_lock is already held by the caller.
+void handle_events_locked(const EventList *events) {
+    for (int i = 0; i < events->count; ++i) {
+        const Event *e = &events->items[i];
+        if (e->type != EV_KILL) continue;
+        if (conn_fd[e->target] >= 0) {
+            shutdown(conn_fd[e->target], SHUT_RDWR);
+            conn_fd[e->target] = -1;
+        }
+        // A dead player has nothing to resume
+        session_token[e->target][0] = '\0';
+        detached[e->target] = 0;
+    }
+}
+
+// Remove a player from the game, shutting down their socket if they have
+// one (its worker closes it, see handle_events_locked).
+// Assumes state_lock is already held by the caller.
+void remove_player_locked(int idx) {
+    Cmd leave = { CMD_LEAVE, idx, 0, 0, 0 };
+    room_apply(room, &leave, NULL);
+    if (conn_fd[idx] >= 0) shutdown(conn_fd[idx], SHUT_RDWR);
+    conn_fd[idx] = -1;
+    session_token[idx][0] = '\0';
+    detached[idx] = 0;
+}
+
+// -------- Resumable Sessions --------
+// Issue a fresh random session token for a slot.
+// Assumes state_lock is already held by the caller.
+void new_session_locked(int idx) {
+    unsigned char raw[SESSION_TOKEN_LEN / 2];
+    if (getrandom(raw, sizeof(raw), 0) != (ssize_t)sizeof(raw)) {
+        // Fall back to rand(); tokens only need to be hard to guess by accident
+        for (size_t i = 0; i < sizeof(raw); ++i) raw[i] = rand();
+    }
+    for (size_t i = 0; i < sizeof(raw); ++i) {
+        snprintf(&session_token[idx][i * 2], 3, "%02x", raw[i]);
+    }
+    detached[idx] = 0;
+    memset(&player_sub[idx], 0, sizeof(player_sub[idx]));
+}
+
+// Keep a dropped player on the board until the grace window expires.
+// Returns 0 if sessions are disabled and the caller should remove the player.
+// Assumes state_lock is already held by the caller.
+int detach_player_locked(int idx) {
+    if (config_current()->resume_grace_ms <= 0 || session_token[idx][0] == '\0') return 0;
+    conn_fd[idx] = -1;
+    detached[idx] = 1;
+    clock_gettime(CLOCK_MONOTONIC, &detached_at[idx]);
+    return 1;
+}
+
+// Remove detached players whose grace window has passed. Returns 1 if any
+// were removed. Assumes state_lock is already held by the caller.
+int reap_sessions_locked() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long grace = config_current()->resume_grace_ms;
+    int changed = 0;
+    for (int i = 0; i < room->params.max_players; ++i) {
+        if (!detached[i]) continue;
+        long ms = (now.tv_sec - detached_at[i].tv_sec) * 1000 +
+                  (now.tv_nsec - detached_at[i].tv_nsec) / 1000000;
+        if (ms >= grace) {
+            printf("Session of player %c expired.\n", room_symbol(i));
+            remove_player_locked(i);
+            changed = 1;
+        }
+    }
+    return changed;
+}
+
+// Copy every player slot into the compact replay representation.
+// Assumes state_lock is already held by the caller.
+void snapshot_locked(ReplayPlayer *snap) {
+    memset(snap, 0, room->params.max_players * sizeof(ReplayPlayer));
+    for (int p = 0; p < room->params.max_players; ++p) {
+        const Player *pl = &room->players[p];
+        snap[p].slot = p;
+        snap[p].active = pl->active;
+        if (pl->active) {
+            snap[p].row = pl->row;
+            snap[p].col = pl->col;
+            snap[p].hp = pl->hp;
+        }
+    }
+}
+
+// Queue the current state as one replay tick. A match starts recording when
+// the first player joins and is finalized once the last player has left;
+// the first tick carries a copy of the map, which may change during play.
+// Assumes state_lock is already held by the caller.
+void record_tick_locked(const ReplayPlayer *snap) {
+    if (!replay_recording && room->player_count == 0) return;
+    ReplayQueue *q = &replay_pending;
+    if (q->count == q->cap) {
+        int cap = q->cap ? q->cap * 2 : 16;
+        ReplayTick *grown = realloc(q->ticks, cap * sizeof(ReplayTick));
+        if (!grown) {
+            fprintf(stderr, "Replay: out of memory, tick dropped\n");
+            return;
+        }
+        q->ticks = grown;
+        q->cap = cap;
+    }
+    ReplayTick *t = &q->ticks[q->count];
+    t->obstacles = NULL;
+    t->finish = 0;
+    if (!replay_recording) {
+        size_t cells = (size_t)room->params.grid_size * room->params.grid_size;
+        t->obstacles = malloc(cells * sizeof(int));
+        if (!t->obstacles) {
+            perror("Replay: could not copy the map");
+            return;
+        }
+        memcpy(t->obstacles, room->obstacles, cells * sizeof(int));
+        snprintf(t->path, sizeof(t->path), "%s/%ld-%u.rpl", REPLAY_DIR, (long)time(NULL), match_seq++);
+        t->seed = room->seed;
+        t->grid_size = room->params.grid_size;
+        t->max_players = room->params.max_players;
+        replay_recording = 1;
+    }
+    memcpy(t->snap, snap, room->params.max_players * sizeof(ReplayPlayer));
+    if (room->player_count == 0) {
+        t->finish = 1;
+        replay_recording = 0;
+    }
+    q->count++;
+}
+
+// Hand the ticks queued so far to the tick thread's writer side; it has
+// written the previous batch, so the buffers simply trade places.
+// Assumes state_lock is already held by the caller.
+void take_replay_ticks_locked() {
+    ReplayQueue spare = replay_writing;
+    replay_writing = replay_pending;
+    replay_pending = spare;
+}
+
+// Write the ticks taken by take_replay_ticks_locked(). Called by the tick
+// thread only, without state_lock.
+void write_replay_ticks() {
+    for (int i = 0; i < replay_writing.count; ++i) {
+        ReplayTick *t = &replay_writing.ticks[i];
+        if (t->obstacles) {
+            replay = replay_begin(t->path, t->seed, t->grid_size, t->obstacles, t->max_players);
+            free(t->obstacles);
+            if (replay) {
+                printf("Recording match to %s\n", t->path);
+            } else {
+                perror("Replay: could not create file");
             }
-            // Check if any active player is at this cell
-            for (int p = 0; p < MAX_PLAYERS; ++p) {
-                if (players[p].active && players[p].row == r && players[p].col == c) {
-                    cell = players[p].symbol;
-                    break;
-                }
+        }
+        if (!replay) continue;
+        if (replay_record(replay, t->snap) < 0) {
+            // Nothing after a partial record can be indexed correctly;
+            // the rest of this match is skipped
+            fprintf(stderr, "Replay: write failed, recording stopped\n");
+            replay_abort(replay);
+            replay = NULL;
+            continue;
+        }
+        if (t->finish) {
+            if (replay_finish(replay) < 0) {
+                fprintf(stderr, "Replay: could not finalize file\n");
             }
-            // Add cell to message (with a space for readability)
-            offset += snprintf(state_msg + offset, sizeof(state_msg) - offset, "%c ", cell);
+            replay = NULL;
         }
-        offset += snprintf(state_msg + offset, sizeof(state_msg) - offset, "\n");
     }
-    // Build players info section
-    offset += snprintf(state_msg + offset, sizeof(state_msg) - offset, "Players:\n");
-    for (int p = 0; p < MAX_PLAYERS; ++p) {
-        if (players[p].active) {
-            offset += snprintf(state_msg + offset, sizeof(state_msg) - offset,
-                                "%c: HP=%d at (%d,%d)\n",
-                                players[p].symbol, players[p].hp,
-                                players[p].row, players[p].col);
+    replay_writing.count = 0;
+}
+
+// Remember the snapshot broadcast as <version> for delta catch-up.
+// Assumes state_lock is already held by the caller.
+void push_history_locked(unsigned long version, const ReplayPlayer *snap) {
+    HistoryEntry *h = &history[history_count % HISTORY_LEN];
+    h->version = version;
+    memcpy(h->snap, snap, room->params.max_players * sizeof(ReplayPlayer));
+    history_count++;
+}
+
+const HistoryEntry *find_history_locked(unsigned long version) {
+    unsigned long kept = history_count < HISTORY_LEN ? history_count : HISTORY_LEN;
+    for (unsigned long i = 1; i <= kept; ++i) {
+        const HistoryEntry *h = &history[(history_count - i) % HISTORY_LEN];
+        if (h->version == version) return h;
+        if (h->version < version) break;
+    }
+    return NULL;
+}
+
+// -------- Multicast Spectator Feed --------
+// Send a keyframe (every slot plus the map) or a delta (slots that changed
+// since the previous datagram) to the multicast group. See mcast.h.
+// Assumes state_lock is already held by the caller.
+void mcast_send_locked(const ReplayPlayer *snap, int keyframe) {
+    static unsigned char datagram[MCAST_MAX_DATAGRAM];
+    int n = room->params.grid_size;
+    int slots = room->params.max_players;
+    size_t map_bytes = ((size_t)n * n + 7) / 8;
+    if (sizeof(McastHeader) + slots * sizeof(McastPlayer) + map_bytes > sizeof(datagram)) {
+        return; // grid too large for one datagram
+    }
+    McastHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MCAST_MAGIC, sizeof(h.magic));
+    h.seq = mcast_seq++;
+    h.version = room->version;
+    h.grid_size = n;
+    h.kind = keyframe ? MCAST_KEYFRAME : MCAST_DELTA;
+    h.max_players = slots;
+    size_t len = sizeof(h);
+    for (int p = 0; p < slots; ++p) {
+        if (!keyframe && memcmp(&snap[p], &mcast_prev[p], sizeof(ReplayPlayer)) == 0) continue;
+        McastPlayer mp = { snap[p].row, snap[p].col, snap[p].hp, snap[p].slot, snap[p].active };
+        memcpy(datagram + len, &mp, sizeof(mp));
+        len += sizeof(mp);
+        h.count++;
+    }
+    if (keyframe) {
+        memset(datagram + len, 0, map_bytes);
+        for (int cell = 0; cell < n * n; ++cell) {
+            if (room->obstacles[cell]) datagram[len + cell / 8] |= 1 << (cell % 8);
         }
+        len += map_bytes;
+        mcast_since_key = 0;
+        clock_gettime(CLOCK_MONOTONIC, &mcast_last_key);
+    }
+    memcpy(datagram, &h, sizeof(h));
+    memcpy(mcast_prev, snap, slots * sizeof(ReplayPlayer));
+    mcast_since_key++;
+    if (sendto(mcast_fd, datagram, len, 0, (struct sockaddr *)&mcast_addr, sizeof(mcast_addr)) < 0) {
+        metric_add(m_mcast_errors, 1);
+    } else {
+        metric_add(m_mcast_sent, 1);
     }
+}
+
+// Publish a state change, or with snap == NULL just keep the feed alive:
+// a keyframe goes out when one is due so late joiners and receivers that
+// lost a datagram catch up. Assumes state_lock is already held.
+void mcast_publish_locked(const ReplayPlayer *snap) {
+    if (mcast_fd < 0) return;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long since_key = (now.tv_sec - mcast_last_key.tv_sec) * 1000 +
+                     (now.tv_nsec - mcast_last_key.tv_nsec) / 1000000;
+    int keyframe = since_key >= MCAST_KEYFRAME_MS || mcast_since_key >= MCAST_KEYFRAME_EVERY;
+    if (snap) {
+        mcast_send_locked(snap, keyframe);
+    } else if (keyframe) {
+        ReplayPlayer current[ROOM_MAX_PLAYERS];
+        snapshot_locked(current);
+        mcast_send_locked(current, 1);
+    }
+}
+
+// Open the UDP socket for the feed. group is "<address>:<port>"; iface is
+// the local address to send from, or NULL for the default route.
+void mcast_open(const char *group, const char *iface) {
+    char address[64];
+    int port;
+    if (sscanf(group, "%63[^:]:%d", address, &port) != 2 || port <= 0 || port > 65535) {
+        fprintf(stderr, "Multicast group must be <address>:<port>.\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(&mcast_addr, 0, sizeof(mcast_addr));
+    mcast_addr.sin_family = AF_INET;
+    mcast_addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, address, &mcast_addr.sin_addr) != 1 ||
+        !IN_MULTICAST(ntohl(mcast_addr.sin_addr.s_addr))) {
+        fprintf(stderr, "%s is not a multicast address.\n", address);
+        exit(EXIT_FAILURE);
+    }
+    if ((mcast_fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+        perror("Multicast socket creation failed");
+        exit(EXIT_FAILURE);
+    }
+    // Stay on the local segment, and let receivers on this host see the feed
+    unsigned char ttl = 1, loop = 1;
+    setsockopt(mcast_fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    setsockopt(mcast_fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+    if (iface) {
+        struct in_addr local;
+        if (inet_pton(AF_INET, iface, &local) != 1 ||
+            setsockopt(mcast_fd, IPPROTO_IP, IP_MULTICAST_IF, &local, sizeof(local)) < 0) {
+            fprintf(stderr, "Invalid multicast interface address %s.\n", iface);
+            exit(EXIT_FAILURE);
+        }
+    }
+    m_mcast_sent = metric_register("mcast_datagrams_total", METRIC_COUNTER);
+    m_mcast_errors = metric_register("mcast_send_errors_total", METRIC_COUNTER);
+    printf("Multicasting the live match to %s.\n", group);
+}
+
+// Build a full state frame: a version line followed by the room rendering.
+// Returns a buffer owned by this function, valid until the next call.
+// Assumes state_lock is already held by the caller.
+const char *state_frame_locked(int *len_out) {
+    static char *state_msg = NULL;
+    static size_t state_cap = 0;
+    size_t cap = 32 + game_state_cap(room->params.grid_size, room->params.max_players);
+    if (cap > state_cap) {
+        char *grown = realloc(state_msg, cap);
+        if (!grown) return NULL;
+        state_msg = grown;
+        state_cap = cap;
+    }
+    int len = snprintf(state_msg, state_cap, "Version: %lu\nTick: %lu\n", room->version, room->tick);
+    len += room_serialize(room, state_msg + len, state_cap - len);
+    *len_out = len;
+    return state_msg;
+}
+
+// -------- State Channels --------
+// Grow a channel buffer pair to hold cap bytes. Returns -1 on failure.
+int channel_reserve(ChannelCache *cc, size_t cap) {
+    if (cap <= cc->cap) return 0;
+    char *text = realloc(cc->text, cap);
+    if (text) cc->text = text;
+    char *scratch = realloc(cc->scratch, cap);
+    if (scratch) cc->scratch = scratch;
+    if (!text || !scratch) return -1;
+    cc->cap = cap;
+    return 0;
+}
+
+// Render a snapshot channel for the current version (once per version).
+// Assumes state_lock is already held by the caller.
+const ChannelCache *channel_locked(Channel ch) {
+    ChannelCache *cc = &channel_cache[ch];
+    if (ch == CH_EVENTS || (cc->version == room->version && cc->seq > 0)) return cc;
+    if (channel_reserve(cc, game_state_cap(room->params.grid_size, room->params.max_players)) < 0) {
+        return cc;
+    }
+    int len = ch == CH_GRID ? room_format_grid(room, cc->scratch, cc->cap)
+            : ch == CH_POSITIONS ? room_format_positions(room, cc->scratch, cc->cap)
+            : room_format_hp(room, cc->scratch, cc->cap);
+    if (len != cc->len || memcmp(cc->scratch, cc->text, len) != 0) {
+        char *swap = cc->text;
+        cc->text = cc->scratch;
+        cc->scratch = swap;
+        cc->len = len;
+        cc->seq++;
+    }
+    cc->version = room->version;
+    return cc;
+}
+
+// Drain the events the room emitted since the last call into the events
+// channel as one batch: an "Events: <first>-<last>" line, then one compact
+// line per event, e.g. "17 hit A B 20". Called once per room tick.
+// Assumes state_lock is already held by the caller.
+void publish_events_locked() {
+    static Event batch[ROOM_EVENT_LOG];
+    int n = room_take_events(room, batch, ROOM_EVENT_LOG);
+    if (n == 0) return;
+    ChannelCache *cc = &channel_cache[CH_EVENTS];
+    if (channel_reserve(cc, 32 + (size_t)n * 32) < 0) return;
+    static const char *BLOCKED[] = { "ok", "bounds", "obstacle", "occupied", "none", "full", "invalid" };
+    char *out = cc->scratch;
+    size_t offset = snprintf(out, cc->cap, "Events: %lu-%lu\n", batch[0].seq, batch[n - 1].seq);
+    for (int i = 0; i < n && offset < cc->cap; ++i) {
+        const Event *e = &batch[i];
+        char who = room_symbol(e->slot);
+        char whom = e->target >= 0 ? room_symbol(e->target) : '-';
+        switch (e->type) {
+        case EV_JOIN:
+            offset += snprintf(out + offset, cc->cap - offset, "%lu join %c %d %d\n", e->seq, who, e->row, e->col);
+            break;
+        case EV_LEAVE:
+            offset += snprintf(out + offset, cc->cap - offset, "%lu leave %c\n", e->seq, who);
+            break;
+        case EV_MOVE:
+            offset += snprintf(out + offset, cc->cap - offset, "%lu move %c %d %d\n", e->seq, who, e->row, e->col);
+            break;
+        case EV_MOVE_BLOCKED: {
+            // The result may come from a rule module, so it is not trusted as an index
+            const char *why = (unsigned)e->value < sizeof(BLOCKED) / sizeof(*BLOCKED) ? BLOCKED[e->value] : "unknown";
+            offset += snprintf(out + offset, cc->cap - offset, "%lu blocked %c %s\n", e->seq, who, why);
+            break;
+        }
+        case EV_HIT:
+            offset += snprintf(out + offset, cc->cap - offset, "%lu hit %c %c %d\n", e->seq, who, whom, e->value);
+            break;
+        case EV_KILL:
+            offset += snprintf(out + offset, cc->cap - offset, "%lu kill %c %c\n", e->seq, who, whom);
+            break;
+        }
+    }
+    if (offset >= cc->cap) offset = cc->cap - 1;
+    cc->scratch = cc->text;
+    cc->text = out;
+    cc->len = offset;
+    cc->version = room->version;
+    cc->seq++;
+    metric_add(m_events, n);
+}
+
+// Announce the terrain chunks that came into a subscriber's view since its
+// last frame: those within TERRAIN_VIEW_CHUNKS of slot's player, or the whole
+// map for spectators (slot -1). Only hashes go out; the client fetches what
+// it has not cached with CHUNK. Returns the length written to out, 0 if no
+// chunk is new. Assumes state_lock is already held by the caller.
+int format_terrain_locked(Subscription *sub, int slot, char *out, size_t cap) {
+    size_t len = 0;
+    if (sub->terrain_version != room->terrain_version) {
+        memset(sub->terrain_seen, 0, sizeof(sub->terrain_seen));
+        sub->terrain_version = room->terrain_version;
+        len = snprintf(out, cap, "Terrain: %d %lu\n", room->params.grid_size, room->terrain_version);
+    }
+    int per_side = room_chunks_per_side(room);
+    int top = 0, left = 0, bottom = per_side - 1, right = per_side - 1;
+    if (slot >= 0 && room->players[slot].active) {
+        int row = room->players[slot].row / ROOM_CHUNK, col = room->players[slot].col / ROOM_CHUNK;
+        if (row - TERRAIN_VIEW_CHUNKS > top) top = row - TERRAIN_VIEW_CHUNKS;
+        if (col - TERRAIN_VIEW_CHUNKS > left) left = col - TERRAIN_VIEW_CHUNKS;
+        if (row + TERRAIN_VIEW_CHUNKS < bottom) bottom = row + TERRAIN_VIEW_CHUNKS;
+        if (col + TERRAIN_VIEW_CHUNKS < right) right = col + TERRAIN_VIEW_CHUNKS;
+    }
+    int announced = 0;
+    for (int r = top; r <= bottom; ++r) {
+        for (int c = left; c <= right && len < cap; ++c) {
+            int i = r * per_side + c;
+            if (sub->terrain_seen[i / 8] & (1 << (i % 8))) continue;
+            sub->terrain_seen[i / 8] |= 1 << (i % 8);
+            len += snprintf(out + len, cap - len, "Chunk: %d %016llx\n", i,
+                            (unsigned long long)room->chunk_hash[i]);
+            announced++;
+        }
+    }
+    if (announced) metric_add(m_chunks_announced, announced);
+    return len < cap ? (int)len : (int)cap - 1;
+}
+
+// Send the subscribed channels that changed since they were last delivered
+// and are not rate limited, as one "Version:" frame written with a single
+// sendmsg() from the shared channel buffers. slot is the subscriber's player
+// slot, -1 for spectators. Returns -1 if the send failed.
+// Assumes state_lock is already held by the caller.
+int send_channels_locked(Subscription *sub, int slot, int sockfd) {
+    static char terrain[64 + TERRAIN_MAX_CHUNKS * 32];
+    struct iovec iov[1 + CH_COUNT];
+    char head[32];
+    int n = 1;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (sub->mask & (1u << CH_TERRAIN)) {
+        int len = format_terrain_locked(sub, slot, terrain, sizeof(terrain));
+        if (len > 0) iov[n++] = (struct iovec) { terrain, len };
+    }
+    for (int ch = 0; ch < CH_COUNT; ++ch) {
+        if (!(sub->mask & (1u << ch)) || ch == CH_TERRAIN) continue;
+        const ChannelCache *cc = channel_locked(ch);
+        if (cc->seq == sub->sent_seq[ch] || cc->len == 0) continue;
+        long since = (now.tv_sec - sub->last_sent[ch].tv_sec) * 1000 +
+                     (now.tv_nsec - sub->last_sent[ch].tv_nsec) / 1000000;
+        if (ch != CH_EVENTS && since < sub->interval_ms[ch]) continue; // sent on a later tick
+        iov[n].iov_base = cc->text;
+        iov[n].iov_len = cc->len;
+        n++;
+        sub->sent_seq[ch] = cc->seq;
+        sub->last_sent[ch] = now;
+    }
+    if (n == 1) return 0;
+    iov[0].iov_base = head;
+    iov[0].iov_len = snprintf(head, sizeof(head), "Version: %lu\nTick: %lu\n", room->version, room->tick);
+    struct msghdr msg = { .msg_iov = iov, .msg_iovlen = n };
+    return sendmsg(sockfd, &msg, 0) < 0 ? -1 : 0;
+}
+
+// Deliver channels that were held back by their rate limit. Called from the
+// room tick. Assumes state_lock is already held by the caller.
+void flush_channels_locked() {
+    for (int p = 0; p < room->params.max_players; ++p) {
+        if (player_sub[p].mask && room->players[p].active && conn_fd[p] >= 0) {
+            send_channels_locked(&player_sub[p], p, conn_fd[p]);
+        }
+    }
+    for (int i = 0; i < spectator_sub_count; ++i) {
+        send_channels_locked(&spectator_subs[i], -1, spectator_subs[i].sockfd);
+    }
+}
+
+// -------- Chat --------
+// Teams only group chat: a player is on team slot % teams.
+int team_of(int slot) {
+    return slot % config_current()->teams;
+}
+
+// Queue one chat line from slot for the room (team_only = 0) or its team.
+// Returns -1 if this tick's batch for the channel is full.
+// Assumes state_lock is already held by the caller.
+int post_chat_locked(int slot, int team_only, const char *text) {
+    int team = team_of(slot);
+    ChatBatch *b = &chat_batch[team_only ? 1 + team : 0];
+    int need = CHAT_MAX_LEN + 32;
+    if (b->len + need > CHAT_BATCH_MAX) return -1;
+    if (b->len == 0) {
+        b->len = team_only ? snprintf(b->text, CHAT_BATCH_MAX, "Chat: team %d\n", team)
+                           : snprintf(b->text, CHAT_BATCH_MAX, "Chat: all\n");
+    }
+    b->len += snprintf(b->text + b->len, CHAT_BATCH_MAX - b->len, "%c: %.*s\n",
+                       room_symbol(slot), CHAT_MAX_LEN, text);
+    return 0;
+}
+
+// Deliver this tick's chat: each player gets the room batch and its team's
+// batch in one sendmsg() from the shared buffers, and spectators get the
+// room batch appended to the fan-out (never superseded by a state frame),
+// so a tick costs one send per recipient however many messages were
+// posted. Assumes state_lock is already held.
+void flush_chat_locked() {
+    int pending = 0;
+    for (int c = 0; c < 1 + ROOM_MAX_PLAYERS; ++c) pending |= chat_batch[c].len > 0;
+    if (!pending) return;
+    for (int p = 0; p < room->params.max_players; ++p) {
+        if (!room->players[p].active || conn_fd[p] < 0) continue;
+        struct iovec iov[2];
+        int n = 0;
+        const ChatBatch *team = &chat_batch[1 + team_of(p)];
+        if (chat_batch[0].len) iov[n++] = (struct iovec) { chat_batch[0].text, chat_batch[0].len };
+        if (team->len) iov[n++] = (struct iovec) { (void *)team->text, team->len };
+        if (n == 0) continue;
+        struct msghdr msg = { .msg_iov = iov, .msg_iovlen = n };
+        sendmsg(conn_fd[p], &msg, MSG_NOSIGNAL);
+    }
+    if (chat_batch[0].len) {
+        fanout_append(spectators, chat_batch[0].text, chat_batch[0].len);
+        for (int i = 0; i < spectator_sub_count; ++i) {
+            send(spectator_subs[i].sockfd, chat_batch[0].text, chat_batch[0].len, MSG_NOSIGNAL);
+        }
+    }
+    for (int c = 0; c < 1 + ROOM_MAX_PLAYERS; ++c) chat_batch[c].len = 0;
+}
+
+// Parse "SUBSCRIBE" arguments: channel names with an optional ":<per-sec>"
+// rate ("hp:2 positions"), or "all" for the classic full frame. The current
+// channel state counts as already delivered. Returns -1 and leaves *sub
+// alone on a parse error. Assumes state_lock is already held by the caller.
+int parse_subscription_locked(const char *args, Subscription *sub) {
+    Subscription next;
+    memset(&next, 0, sizeof(next));
+    next.sockfd = sub->sockfd;
+    char copy[256], *save = NULL;
+    snprintf(copy, sizeof(copy), "%s", args);
+    for (char *tok = strtok_r(copy, " ,", &save); tok; tok = strtok_r(NULL, " ,", &save)) {
+        if (strcasecmp(tok, "all") == 0) {
+            next.mask = 0;
+            break;
+        }
+        int rate = 0;
+        char *colon = strchr(tok, ':');
+        if (colon) {
+            *colon = '\0';
+            rate = atoi(colon + 1);
+            if (rate <= 0 || rate > 1000) return -1;
+        }
+        int ch = 0;
+        while (ch < CH_COUNT && strcasecmp(tok, CHANNEL_NAMES[ch]) != 0) ch++;
+        if (ch == CH_COUNT) return -1;
+        next.mask |= 1u << ch;
+        next.interval_ms[ch] = rate ? 1000 / rate : 0;
+    }
+    for (int ch = 0; ch < CH_COUNT; ++ch) {
+        if (ch != CH_TERRAIN) next.sent_seq[ch] = channel_locked(ch)->seq;
+    }
+    *sub = next;
+    return 0;
+}
+
+// Confirm a subscription change: "Subscribed: hp(2/s) positions\n".
+void send_subscription_reply(int sockfd, const Subscription *sub) {
+    char reply[128];
+    int len = snprintf(reply, sizeof(reply), "Subscribed:");
+    if (!sub->mask) len += snprintf(reply + len, sizeof(reply) - len, " all (full frames)");
+    for (int ch = 0; ch < CH_COUNT; ++ch) {
+        if (!(sub->mask & (1u << ch))) continue;
+        len += snprintf(reply + len, sizeof(reply) - len, " %s", CHANNEL_NAMES[ch]);
+        if (sub->interval_ms[ch]) {
+            len += snprintf(reply + len, sizeof(reply) - len, "(%d/s)", 1000 / sub->interval_ms[ch]);
+        }
+    }
+    len += snprintf(reply + len, sizeof(reply) - len, "\n");
+    send(sockfd, reply, len, 0);
+}
+
+// Reply to "CHUNK <index> ...": the content of up to TERRAIN_FETCH_MAX
+// terrain chunks as ChunkData lines, in one send. Bad indices are skipped.
+void send_chunks(int sockfd, const char *args) {
+    char reply[TERRAIN_FETCH_MAX * (TERRAIN_CHUNK_BYTES * 2 + 48)];
+    size_t len = 0;
+    int sent = 0;
+    pthread_mutex_lock(&state_lock);
+    int chunks = room_chunks_per_side(room) * room_chunks_per_side(room);
+    char *end;
+    for (long i = strtol(args, &end, 10); end != args && sent < TERRAIN_FETCH_MAX;
+         i = strtol(args, &end, 10)) {
+        args = end;
+        if (i < 0 || i >= chunks) continue;
+        uint8_t bits[TERRAIN_CHUNK_BYTES];
+        room_chunk_bits(room, i, bits);
+        len += snprintf(reply + len, sizeof(reply) - len, "ChunkData: %ld %016llx ", i,
+                        (unsigned long long)room->chunk_hash[i]);
+        for (int b = 0; b < TERRAIN_CHUNK_BYTES; ++b) {
+            len += snprintf(reply + len, sizeof(reply) - len, "%02x", bits[b]);
+        }
+        reply[len++] = '\n';
+        sent++;
+    }
+    pthread_mutex_unlock(&state_lock);
+    if (sent == 0) {
+        const char *msg = "Usage: CHUNK <index> [<index> ...]\n";
+        send(sockfd, msg, strlen(msg), 0);
+        return;
+    }
+    send(sockfd, reply, len, 0);
+    metric_add(m_chunks_sent, sent);
+}
+
+// Send a state frame to live spectators. While spectator frames are shed,
+// at most one goes out per SHED_SPECTATOR_MS and the room tick catches them
+// up with the newest state later. Assumes state_lock is already held.
+void publish_spectators_locked(const char *frame, int len) {
+    if (spectator_version == room->version) return;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (atomic_load(&overload_level) >= LOAD_SHED_SPECTATORS) {
+        long since = (now.tv_sec - spectator_sent_at.tv_sec) * 1000 +
+                     (now.tv_nsec - spectator_sent_at.tv_nsec) / 1000000;
+        if (since < SHED_SPECTATOR_MS) {
+            metric_add(m_frames_shed, 1);
+            return;
+        }
+    }
+    fanout_publish(spectators, frame, len);
+    for (int i = 0; i < spectator_sub_count; ++i) {
+        send_channels_locked(&spectator_subs[i], -1, spectator_subs[i].sockfd);
+    }
+    spectator_version = room->version;
+    spectator_sent_at = now;
+}
+
+// Send spectators the newest state if shedding held it back.
+// Assumes state_lock is already held by the caller.
+void catch_up_spectators_locked() {
+    if (spectator_version == room->version) return;
+    if (fanout_count(spectators) == 0 && spectator_sub_count == 0) {
+        spectator_version = room->version;
+        return;
+    }
+    int len;
+    const char *frame = state_frame_locked(&len);
+    if (frame) publish_spectators_locked(frame, len);
+}
+
+// Helper function to send the current game state to all connected clients
+// and live spectators, except the player in skip_slot (-1 for nobody).
+// Assumes state_lock is already held by the caller.
+void broadcast_state_except_locked(int skip_slot) {
+    int len;
+    const char *state_msg = state_frame_locked(&len);
+    if (!state_msg) return;
+    ReplayPlayer snap[ROOM_MAX_PLAYERS];
+    snapshot_locked(snap);
+    push_history_locked(room->version, snap);
+    int removed = 0;
 
     // Send the state message to all active players.
     // Handle if any client disconnects during send.
-    for (int p = 0; p < MAX_PLAYERS; ++p) {
-        if (!players[p].active) continue;
-        int sock = players[p].socket_fd;
+    for (int p = 0; p < room->params.max_players; ++p) {
+        if (!room->players[p].active || p == skip_slot) continue;
+        int sock = conn_fd[p];
         if (sock < 0) continue;
-        // Attempt to send the state message
-        ssize_t bytes = send(sock, state_msg, strlen(state_msg), 0);
+        // Attempt to send the state message, or only the subscribed channels
+        ssize_t bytes = player_sub[p].mask ? send_channels_locked(&player_sub[p], p, sock)
+                                           : send(sock, state_msg, len, 0);
         if (bytes < 0) {
-            // Send failed: likely client disconnected
-            fprintf(stderr, "Broadcast: client %c send failed, removing player\n", players[p].symbol);
-            // Remove this player from game
-            close(sock);
-            players[p].socket_fd = -1;
-            players[p].active = 0;
-            player_count--;
+            // Send failed: likely client disconnected. Keep the player
+            // resumable if sessions are enabled, otherwise remove them.
+            fprintf(stderr, "Broadcast: client %c send failed, dropping connection\n", room_symbol(p));
+            shutdown(sock, SHUT_RDWR);
+            if (!detach_player_locked(p)) {
+                remove_player_locked(p);
+                removed = 1;
+            }
             // Note: We do not attempt to re-send current state to this client (they're gone).
             // We will handle broadcasting the updated state (with this player removed) 
             // in the next command cycle or below if needed.
         }
     }
+    // Spectators get the same frame through the fan-out threads; a failed
+    // send is cleaned up by the spectator's own thread when its recv()
+    // notices the disconnect.
+    publish_spectators_locked(state_msg, len);
+    // Re-snapshot for the replay if failed sends removed players
+    if (removed) snapshot_locked(snap);
+    record_tick_locked(snap);
+    mcast_publish_locked(snap);
+}
+
+void broadcast_state_locked() {
+    broadcast_state_except_locked(-1);
+}
+
+// Bring a resuming client up to date: only the slots that changed since
+// last_version if that version is still in the history, otherwise a full
+// state frame. Assumes state_lock is already held by the caller.
+void send_catchup_locked(int sockfd, unsigned long last_version) {
+    const HistoryEntry *h = find_history_locked(last_version);
+    if (!h) {
+        int len;
+        const char *frame = state_frame_locked(&len);
+        if (frame) send(sockfd, frame, len, 0);
+        return;
+    }
+    ReplayPlayer now[ROOM_MAX_PLAYERS];
+    snapshot_locked(now);
+    char delta[64 + ROOM_MAX_PLAYERS * 48];
+    int len = snprintf(delta, sizeof(delta), "Delta: v%lu -> v%lu\n", last_version, room->version);
+    for (int p = 0; p < room->params.max_players; ++p) {
+        if (memcmp(&h->snap[p], &now[p], sizeof(ReplayPlayer)) == 0) continue;
+        if (now[p].active) {
+            len += snprintf(delta + len, sizeof(delta) - len, "%c: HP=%d at (%d,%d)\n",
+                            room_symbol(p), now[p].hp, now[p].row, now[p].col);
+        } else {
+            len += snprintf(delta + len, sizeof(delta) - len, "%c: gone\n", room_symbol(p));
+        }
+    }
+    send(sockfd, delta, len, 0);
 }
 
-// Thread function to handle communication with a client
-// -------- Thread Routine for Client Handling --------
-void *client_handler(void *arg) {
-    int player_index = (intptr_t) arg;
-    int sockfd = players[player_index].socket_fd;
+// Rebind sockfd to the detached slot holding <token>. current_slot is the
+// slot this connection was given on accept (or -1); it is released so the
+// player continues where they left off. Returns the resumed slot or -1.
+// Assumes state_lock is already held by the caller.
+int resume_session_locked(int sockfd, const char *token, unsigned long last_version, int current_slot) {
+    int slot = -1;
+    for (int i = 0; i < room->params.max_players; ++i) {
+        if (detached[i] && strcmp(session_token[i], token) == 0) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0) {
+        const char *msg = "Resume failed: unknown or expired session.\n";
+        send(sockfd, msg, strlen(msg), 0);
+        return -1;
+    }
+    int released = 0;
+    if (current_slot >= 0 && conn_fd[current_slot] == sockfd) {
+        conn_fd[current_slot] = -1;
+        remove_player_locked(current_slot);
+        released = 1;
+    }
+    conn_fd[slot] = sockfd;
+    detached[slot] = 0;
+    char msg[64];
+    snprintf(msg, sizeof(msg), "Resumed as player %c.\n", room_symbol(slot));
+    send(sockfd, msg, strlen(msg), 0);
+    // Everyone else sees the temporary slot disappear; the resumed client
+    // gets only its delta
+    if (released) broadcast_state_except_locked(slot);
+    send_catchup_locked(sockfd, last_version);
+    return slot;
+}
+
+// -------- Server-side Bots --------
+// Keep the configured number of bots in the game while at least one human is
+// playing, and remove them all once the last human leaves so the match ends.
+// Returns 1 if the roster changed. Assumes state_lock is already held.
+int balance_bots_locked() {
+    int changed = 0;
+    int humans = room->player_count - room->bot_count;
+    for (int i = 0; i < room->params.max_players; ++i) {
+        if (humans == 0 && room->players[i].active && room->players[i].is_bot) {
+            remove_player_locked(i);
+            changed = 1;
+        } else if (humans > 0 && room->bot_count < config_current()->bots &&
+                   !room->players[i].active) {
+            conn_fd[i] = -1;
+            room_spawn(room, i, 1, NULL);
+            changed = 1;
+        }
+    }
+    return changed;
+}
+
+// Make room for a human by removing one bot. Returns 1 if a slot was freed.
+// Assumes state_lock is already held by the caller.
+int evict_bot_locked() {
+    for (int i = 0; i < room->params.max_players; ++i) {
+        if (room->players[i].active && room->players[i].is_bot) {
+            remove_player_locked(i);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Put the newest loaded rule module into effect. Called at a tick boundary,
+// so every command of a tick runs under one rule set.
+// Assumes state_lock is already held by the caller.
+void swap_rules_locked() {
+    const RuleModule *want = atomic_load(&next_rules);
+    if (room->rules == want) return;
+    room->rules = want;
+    metric_set(metric_register("rules_version", METRIC_GAUGE), want->version);
+    metric_add(metric_register("rules_swaps_total", METRIC_COUNTER), 1);
+    printf("Rules: %s version %d in effect\n", want->name, want->version);
+    fflush(stdout);
+}
+
+// -------- Overload Protection --------
+// Resident set size of the server in MB.
+long rss_mb() {
+    long pages = 0, resident = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (!fp) return 0;
+    if (fscanf(fp, "%ld %ld", &pages, &resident) != 2) resident = 0;
+    fclose(fp);
+    return resident * (sysconf(_SC_PAGESIZE) / 1024) / 1024;
+}
+
+// Set the overload level from the worst of three signals, each measured
+// against its configured threshold: how late the room tick ran (lag_ms,
+// including the wait for state_lock), connections and commands queued, and
+// RSS. Up to 1x a threshold is normal, then every doubling sheds one more
+// kind of work. The level rises at once and steps down one level after
+// OVERLOAD_CALM_TICKS calm ticks. Called once per room tick.
+// Assumes state_lock is already held by the caller.
+void update_overload_locked(long lag_ms) {
+    static int calm_ticks = 0;
+    const Config *cfg = config_current();
+    pthread_mutex_lock(&pool_lock);
+    int queued = work_count + atomic_load(&commands_waiting);
+    pthread_mutex_unlock(&pool_lock);
+    long rss = rss_mb();
+    long pressure = 0;   // percent of the tightest threshold
+    if (cfg->overload_lag_ms > 0 && lag_ms * 100 / cfg->overload_lag_ms > pressure) {
+        pressure = lag_ms * 100 / cfg->overload_lag_ms;
+    }
+    if (cfg->overload_queue > 0 && queued * 100L / cfg->overload_queue > pressure) {
+        pressure = queued * 100L / cfg->overload_queue;
+    }
+    if (cfg->overload_rss_mb > 0 && rss * 100 / cfg->overload_rss_mb > pressure) {
+        pressure = rss * 100 / cfg->overload_rss_mb;
+    }
+    int target = pressure < 100 ? LOAD_NORMAL : pressure < 200 ? LOAD_SHED_SPECTATORS
+               : pressure < 400 ? LOAD_DEFER_JOINS : LOAD_SLOW_TICKS;
+    int level = atomic_load(&overload_level);
+    if (target > level) {
+        level = target;
+        calm_ticks = 0;
+    } else if (target == level) {
+        calm_ticks = 0;
+    } else if (++calm_ticks >= OVERLOAD_CALM_TICKS) {
+        level--;
+        calm_ticks = 0;
+    }
+    if (level != atomic_load(&overload_level)) {
+        static const char *NAMES[] = { "normal", "shedding spectator frames", "deferring joins", "slowing ticks" };
+        printf("Overload: %s (lag %ld ms, %d queued, %ld MB)\n", NAMES[level], lag_ms, queued, rss);
+        fflush(stdout);
+        atomic_store(&overload_level, level);
+    }
+    metric_set(m_overload_level, level);
+    metric_set(m_tick_lag, lag_ms);
+    metric_set(m_rss, rss);
+}
+
+// -------- Tick Rate Controller --------
+typedef struct {
+    int period_ms;               // current tick period
+    int quiet_ticks;             // consecutive ticks without commands or bots
+    int since_overload;          // ticks since the last back-off
+    struct timespec wall, cpu;   // previous sample for the CPU headroom
+    long cores;
+} TickController;
+
+// Percent of host CPU this process left unused since the previous call.
+int cpu_headroom(TickController *tc) {
+    struct timespec wall, cpu;
+    clock_gettime(CLOCK_MONOTONIC, &wall);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu);
+    double wall_s = (wall.tv_sec - tc->wall.tv_sec) + (wall.tv_nsec - tc->wall.tv_nsec) / 1e9;
+    double cpu_s = (cpu.tv_sec - tc->cpu.tv_sec) + (cpu.tv_nsec - tc->cpu.tv_nsec) / 1e9;
+    tc->wall = wall;
+    tc->cpu = cpu;
+    if (wall_s <= 0) return 100;
+    int used = (int)(100 * cpu_s / (wall_s * tc->cores));
+    return used >= 100 ? 0 : 100 - used;
+}
+
+// Pick the next tick period between tick_ms and idle_tick_ms. A room with no
+// commands and no bots for IDLE_AFTER_TICKS drops to the heartbeat, and the
+// next command wakes it at once. A busy room gets tick_ms unless the last
+// tick cost more than TICK_BUSY_PERCENT of its period, the host ran out of
+// CPU or commands are piling up on state_lock; then the period stretches by
+// a quarter per tick, and after that shrinks back by a fifth per tick.
+// Assumes state_lock is already held by the caller.
+int tick_period_locked(TickController *tc, long tick_cost_ns, long commands) {
+    const Config *cfg = config_current();
+    int full = cfg->tick_ms, idle = cfg->idle_tick_ms > cfg->tick_ms ? cfg->idle_tick_ms : cfg->tick_ms;
+    int headroom = cpu_headroom(tc);
+    int waiting = atomic_load(&commands_waiting);
+    metric_set(m_headroom, headroom);
+    metric_set(m_waiting, waiting);
+    metric_set(m_tick_cost, tick_cost_ns);
+
+    tc->quiet_ticks = commands > 0 || room->bot_count > 0 ? 0 : tc->quiet_ticks + 1;
+    int want = tc->quiet_ticks >= IDLE_AFTER_TICKS ? idle : full;
+    // Last shedding stage: the room ticks at half rate. Commands are applied
+    // as they arrive, so players' own latency is unaffected, and they never
+    // wake a tick that is not idle, so a command flood cannot undo this
+    if (atomic_load(&overload_level) >= LOAD_SLOW_TICKS && want < full * 2) want = full * 2;
+    int overloaded = tick_cost_ns / 10000 > (long)TICK_BUSY_PERCENT * tc->period_ms ||
+                     headroom < CPU_HEADROOM_MIN || waiting > COMMANDS_WAITING_MAX;
+    if (overloaded) {
+        tc->since_overload = 0;
+        int stretched = tc->period_ms + tc->period_ms / 4 + 1;
+        if (want < stretched) want = stretched < idle ? stretched : idle;
+    } else if (tc->since_overload++ < IDLE_AFTER_TICKS * 2 && want < tc->period_ms) {
+        // Recovering from a back-off: approach the full rate gradually
+        int shrunk = tc->period_ms - tc->period_ms / 5;
+        if (want < shrunk) want = shrunk;
+    }
+    if (want != tc->period_ms) {
+        tc->period_ms = want;
+        metric_add(m_tick_adjust, 1);
+    }
+    metric_set(m_tick_period, tc->period_ms);
+    return tc->period_ms;
+}
+
+// Sleep for one tick period. An idle heartbeat (idle set: the room has been
+// quiet for IDLE_AFTER_TICKS) can be cut short by a command, see
+// lock_for_command; any other period, including one stretched by overload,
+// is slept in full so commands cannot undo the back-off.
+void wait_for_tick(int period_ms, int idle) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += period_ms / 1000;
+    deadline.tv_nsec += (period_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_mutex_lock(&tick_wake_lock);
+    atomic_store(&tick_idle, idle);
+    if (idle) {
+        pthread_cond_timedwait(&tick_wake, &tick_wake_lock, &deadline);
+    } else {
+        pthread_mutex_unlock(&tick_wake_lock);
+        struct timespec period = { period_ms / 1000, (period_ms % 1000) * 1000000L };
+        nanosleep(&period, NULL);
+        pthread_mutex_lock(&tick_wake_lock);
+    }
+    atomic_store(&tick_idle, 0);
+    pthread_mutex_unlock(&tick_wake_lock);
+}
+
+// Take state_lock for a player command, counting it for the tick controller
+// and waking an idle room's tick thread.
+void lock_for_command() {
+    atomic_fetch_add(&commands_since_tick, 1);
+    if (atomic_load(&tick_idle)) {
+        pthread_mutex_lock(&tick_wake_lock);
+        pthread_cond_signal(&tick_wake);
+        pthread_mutex_unlock(&tick_wake_lock);
+    }
+    atomic_fetch_add(&commands_waiting, 1);
+    pthread_mutex_lock(&state_lock);
+    atomic_fetch_sub(&commands_waiting, 1);
+}
+
+// Room tick: decide for every bot in one batched pass over the player
+// columns, apply the intents through the normal rules, then broadcast once.
+void *bot_tick_thread(void *arg) {
+    (void)arg;
+    unsigned int rng = room->seed;
+    int32_t row[ROOM_MAX_PLAYERS], col[ROOM_MAX_PLAYERS], hp[ROOM_MAX_PLAYERS];
+    unsigned char is_bot[ROOM_MAX_PLAYERS];
+    BotIntent intents[ROOM_MAX_PLAYERS];
+    Metric *m_bots = metric_register("bots_active", METRIC_GAUGE);
+    Metric *m_ticks = metric_register("bot_ticks_total", METRIC_COUNTER);
+    Metric *m_tick_ns = metric_register("bot_tick_ns", METRIC_GAUGE);
+    Metric *m_bot_ns = metric_register("bot_ns_per_bot", METRIC_GAUGE);
+    struct timespec last_balance = { 0, 0 };
+    TickController tc = { .period_ms = config_current()->tick_ms, .cores = sysconf(_SC_NPROCESSORS_ONLN) };
+    if (tc.cores < 1) tc.cores = 1;
+    cpu_headroom(&tc);
+    while (1) {
+        struct timespec slept;
+        clock_gettime(CLOCK_MONOTONIC, &slept);
+        wait_for_tick(tc.period_ms, tc.quiet_ticks >= IDLE_AFTER_TICKS);
+        pthread_mutex_lock(&state_lock);
+        struct timespec tick_start;
+        clock_gettime(CLOCK_MONOTONIC, &tick_start);
+        // How late this tick started: oversleeping plus the wait for the lock
+        long lag_ms = (tick_start.tv_sec - slept.tv_sec) * 1000 +
+                      (tick_start.tv_nsec - slept.tv_nsec) / 1000000 - tc.period_ms;
+        // Record where everyone stood during the tick that just ended, for
+        // lag-compensated attacks, and start the next one
+        room_end_tick(room);
+        swap_rules_locked();
+        int changed = reap_sessions_locked();
+        changed |= balance_bots_locked();
+        if (room->bot_count > 0) {
+            struct timespec t0, t1;
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            // Columns for the decision kernel; inactive slots sit at BOT_FAR
+            int slots = room->params.max_players;
+            for (int p = 0; p < slots; ++p) {
+                const Player *pl = &room->players[p];
+                row[p] = pl->active ? pl->row : BOT_FAR;
+                col[p] = pl->active ? pl->col : BOT_FAR;
+                hp[p] = pl->hp;
+                is_bot[p] = pl->is_bot;
+            }
+            BotView view = { room->params.grid_size, room->obstacles, slots, row, col, hp, is_bot };
+            int n = bots_decide(&view, intents, &rng);
+            int bots = room->bot_count;
+            for (int i = 0; i < n; ++i) {
+                int b = intents[i].slot;
+                // An earlier intent this tick may have killed this bot
+                if (!room->players[b].active || !room->players[b].is_bot) continue;
+                if (intents[i].action == BOT_IDLE) continue;
+                Cmd cmd = { CMD_MOVE, b, intents[i].dr, intents[i].dc, 0 };
+                if (intents[i].action == BOT_ATTACK) cmd.type = CMD_ATTACK;
+                EventList events = { .count = 0 };
+                changed |= room_apply(room, &cmd, &events) == RES_OK;
+                handle_events_locked(&events);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            long ns = (t1.tv_sec - t0.tv_sec) * 1000000000L + (t1.tv_nsec - t0.tv_nsec);
+            metric_add(m_ticks, 1);
+            metric_set(m_tick_ns, ns);
+            metric_set(m_bot_ns, ns / bots);
+        }
+        metric_set(m_bots, room->bot_count);
+        publish_events_locked();
+        if (changed) {
+            broadcast_state_locked();
+        } else {
+            mcast_publish_locked(NULL);
+            flush_channels_locked();
+        }
+        flush_chat_locked();
+        catch_up_spectators_locked();
+        update_overload_locked(lag_ms > 0 ? lag_ms : 0);
+        struct timespec tick_end;
+        clock_gettime(CLOCK_MONOTONIC, &tick_end);
+        long cost_ns = (tick_end.tv_sec - tick_start.tv_sec) * 1000000000L + (tick_end.tv_nsec - tick_start.tv_nsec);
+        tick_period_locked(&tc, cost_ns, atomic_exchange(&commands_since_tick, 0));
+        take_replay_ticks_locked();
+        pthread_mutex_unlock(&state_lock);
+        write_replay_ticks();
+        // Move spectator sockets off busy fan-out threads; this takes only
+        // the fan-out locks, so it runs outside state_lock
+        if ((tick_end.tv_sec - last_balance.tv_sec) * 1000 +
+            (tick_end.tv_nsec - last_balance.tv_nsec) / 1000000 >= FANOUT_BALANCE_MS) {
+            fanout_balance(spectators);
+            last_balance = tick_end;
+        }
+    }
+    return NULL;
+}
+
+// -------- Checkpoints --------
+// Continue the world saved in checkpoint_path, if there is one. Players who
+// had a session come back detached, so their clients can RESUME within the
+// grace window; the others are removed. Bots stay where they were.
+// Assumes state_lock is already held by the caller.
+void restore_checkpoint_locked() {
+    char err[320];
+    Room *saved = checkpoint_restore(checkpoint_path, session_token, err, sizeof(err));
+    if (!saved) {
+        printf("Checkpoint: %s, starting a new world\n", err);
+        return;
+    }
+    room_destroy(room);
+    room = saved;
+    for (int i = 0; i < room->params.max_players; ++i) {
+        if (!room->players[i].active || room->players[i].is_bot) continue;
+        if (!detach_player_locked(i)) remove_player_locked(i);
+    }
+    printf("Checkpoint: restored a %dx%d world at version %lu with %d players\n",
+           room->params.grid_size, room->params.grid_size, room->version, room->player_count);
+}
+
+// Checkpoint the room every checkpoint_ms. Only what changed since the last
+// checkpoint is copied, under state_lock; the write and sync happen after
+// the lock is released so a slow disk never holds up the room.
+void *checkpoint_thread(void *arg) {
+    CheckpointLog *log = arg;
+    Metric *m_errors = metric_register("checkpoint_errors_total", METRIC_COUNTER);
+    Metric *m_records = metric_register("checkpoint_records_total", METRIC_COUNTER);
+    Metric *m_bytes = metric_register("checkpoint_bytes_total", METRIC_COUNTER);
+    Metric *m_compactions = metric_register("checkpoint_compactions_total", METRIC_COUNTER);
+    while (1) {
+        int ms = config_current()->checkpoint_ms;
+        struct timespec period = { ms / 1000, (ms % 1000) * 1000000L };
+        nanosleep(&period, NULL);
+
+        pthread_mutex_lock(&state_lock);
+        int records = checkpoint_collect(log, room, session_token);
+        pthread_mutex_unlock(&state_lock);
+        if (records == 0) continue;
+        long bytes = checkpoint_flush(log);
+        if (bytes < 0) {
+            metric_add(m_errors, 1);
+            continue;
+        }
+        metric_add(m_records, records);
+        metric_add(m_bytes, bytes);
+        if (checkpoint_compacted(log)) {
+            metric_add(m_compactions, 1);
+        }
+    }
+    return NULL;
+}
+
+// -------- Headless Simulation Benchmark --------
+typedef struct {
+    RoomParams params;
+    double seconds;
+    unsigned int seed;
+    long commands, ticks, moves_ok, moves_blocked, attacks, hits, joins, leaves;
+    double elapsed;
+} HeadlessRun;
+
+// Drive one private room with synthetic players and no sockets: a third of
+// the slots walk randomly, a third attack, and a third churn (leave and
+// rejoin). Commands go straight through room_apply(), so the numbers are the
+// cost of the game core alone.
+void *headless_thread(void *arg) {
+    enum { WALKER, ATTACKER, CHURNER };
+    static const int DIRS[4][2] = { {-1, 0}, {1, 0}, {0, -1}, {0, 1} };
+    HeadlessRun *run = arg;
+    RoomParams params = run->params;
+    Room *r = room_create(&params, run->seed);
+    Event *taken = malloc(ROOM_EVENT_LOG * sizeof(Event));
+    if (!r || !taken) {
+        if (r) room_destroy(r);
+        free(taken);
+        return NULL;
+    }
+    r->rules = atomic_load(&next_rules);
+    unsigned int rng = run->seed;
+    EventList events;
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    while (run->elapsed < run->seconds) {
+        for (int p = 0; p < params.max_players; ++p) {
+            int profile = p % 3;
+            events.count = 0;
+            Cmd cmd = { CMD_MOVE, p, 0, 0, 0 };
+            if (!r->players[p].active) {
+                // Empty (killed or churned) slots rejoin on the next tick
+                room_spawn(r, p, 0, &events);
+                run->joins++;
+                run->commands++;
+                continue;
+            } else if (profile == CHURNER && rand_r(&rng) % 8 == 0) {
+                cmd.type = CMD_LEAVE;
+                run->leaves++;
+            } else if (profile == ATTACKER && rand_r(&rng) % 2 == 0) {
+                cmd.type = CMD_ATTACK;
+                run->attacks++;
+            } else {
+                const int *d = DIRS[rand_r(&rng) % 4];
+                cmd.dr = d[0];
+                cmd.dc = d[1];
+            }
+            RoomResult res = room_apply(r, &cmd, &events);
+            if (cmd.type == CMD_MOVE) {
+                if (res == RES_OK) run->moves_ok++;
+                else run->moves_blocked++;
+            }
+            for (int e = 0; e < events.count; ++e) {
+                if (events.items[e].type == EV_HIT) run->hits++;
+            }
+            run->commands++;
+        }
+        // Drain the event log as the live tick does (publish_events_locked),
+        // so emits keep taking the append path instead of the full-log one
+        room_take_events(r, taken, ROOM_EVENT_LOG);
+        room_end_tick(r);
+        run->ticks++;
+        // Check the clock every 1024 ticks to keep it out of the measurement
+        if ((run->ticks & 1023) == 0) {
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            run->elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+        }
+    }
+    room_destroy(r);
+    free(taken);
+    return NULL;
+}
+
+// Run one room per online CPU and report per-core and total throughput.
+void run_headless(const RoomParams *params, double seconds) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1) cores = 1;
+    HeadlessRun *runs = calloc(cores, sizeof(HeadlessRun));
+    pthread_t *threads = calloc(cores, sizeof(pthread_t));
+    if (!runs || !threads) {
+        fprintf(stderr, "Headless: out of memory\n");
+        return;
+    }
+    for (long i = 0; i < cores; ++i) {
+        runs[i].params = *params;
+        runs[i].seconds = seconds;
+        runs[i].seed = time(NULL) + i;
+        pthread_create(&threads[i], NULL, headless_thread, &runs[i]);
+    }
+    HeadlessRun total;
+    memset(&total, 0, sizeof(total));
+    for (long i = 0; i < cores; ++i) {
+        pthread_join(threads[i], NULL);
+        total.commands += runs[i].commands;
+        total.ticks += runs[i].ticks;
+        total.moves_ok += runs[i].moves_ok;
+        total.moves_blocked += runs[i].moves_blocked;
+        total.attacks += runs[i].attacks;
+        total.hits += runs[i].hits;
+        total.joins += runs[i].joins;
+        total.leaves += runs[i].leaves;
+        if (runs[i].elapsed > total.elapsed) total.elapsed = runs[i].elapsed;
+    }
+    double el = total.elapsed;
+    printf("Headless simulation: %ld room(s) of %d slots on a %dx%d grid, %.2f s\n",
+           cores, params->max_players, params->grid_size, params->grid_size, el);
+    printf("  per core: %.0f commands/s, %.0f ticks/s (%.1f ns/command)\n",
+           total.commands / el / cores, total.ticks / el / cores,
+           el * 1e9 * cores / total.commands);
+    printf("  total:    %.0f commands/s, %.0f ticks/s\n", total.commands / el, total.ticks / el);
+    printf("  moves ok=%ld blocked=%ld, attacks=%ld hits=%ld, joins=%ld leaves=%ld\n",
+           total.moves_ok, total.moves_blocked, total.attacks, total.hits,
+           total.joins, total.leaves);
+    free(runs);
+    free(threads);
+}
+
+// -------- Configuration Reload --------
+// Load the config file on top of the command-line settings and publish it.
+// Returns 0 on success; on failure the previous configuration stays live.
+int reload_config() {
+    Config *cfg = malloc(sizeof(*cfg));
+    if (!cfg) return -1;
+    char err[256];
+    if (config_load(config_path, &base_config, cfg, err, sizeof(err)) < 0) {
+        fprintf(stderr, "Config: %s; keeping the current settings\n", err);
+        free(cfg);
+        return -1;
+    }
+    // Load a changed rule module now, outside state_lock; a module that
+    // fails to load rejects the whole reload
+    if (strcmp(cfg->rule_module, rules_path) != 0) {
+        const RuleModule *rules = &room_default_rules;
+        if (cfg->rule_module[0] && !(rules = rules_load(cfg->rule_module, err, sizeof(err)))) {
+            fprintf(stderr, "Config: %s; keeping the current settings\n", err);
+            free(cfg);
+            return -1;
+        }
+        strcpy(rules_path, cfg->rule_module);
+        atomic_store(&next_rules, rules);
+    }
+    config_publish(cfg);
+    return 0;
+}
+
+// Wait for SIGHUP and re-read the config file. SIGHUP is blocked in every
+// other thread, so the reload never interrupts a handler mid-command.
+void *config_thread(void *arg) {
+    (void)arg;
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGHUP);
+    Metric *m_reloads = metric_register("config_reloads_total", METRIC_COUNTER);
+    Metric *m_generation = metric_register("config_generation", METRIC_GAUGE);
+    metric_set(m_generation, config_current()->generation);
+    while (1) {
+        int sig;
+        if (sigwait(&set, &sig) != 0) continue;
+        if (!config_path) {
+            fprintf(stderr, "Config: SIGHUP received but no config file was given\n");
+            continue;
+        }
+        if (reload_config() == 0) {
+            const Config *cfg = config_current();
+            metric_add(m_reloads, 1);
+            metric_set(m_generation, cfg->generation);
+            printf("Config: reloaded %s (generation %lu)\n", config_path, cfg->generation);
+            fflush(stdout);
+        }
+    }
+    return NULL;
+}
+
+// Start the next match in a fresh room if the room parameters changed since
+// the current room was created. Only done while the room is empty.
+// Assumes state_lock is already held by the caller.
+void refresh_room_locked() {
+    const RoomParams *want = &config_current()->room;
+    if (room->player_count > 0 || memcmp(want, &room->params, sizeof(*want)) == 0) return;
+    Room *fresh = room_create(want, time(NULL));
+    if (!fresh) {
+        fprintf(stderr, "Config: could not create a room with the new parameters\n");
+        return;
+    }
+    // Versions keep counting up across rooms; history of the old room is useless
+    fresh->version = room->version + 1;
+    fresh->event_seq = room->event_seq;
+    fresh->rules = room->rules;
+    fresh->terrain_version = room->terrain_version + 1;
+    history_count = 0;
+    mcast_since_key = MCAST_KEYFRAME_EVERY; // new map: the next datagram is a keyframe
+    room_destroy(room);
+    room = fresh;
+    printf("New room: %dx%d grid, %d slots, HP %d, damage %d\n",
+           want->grid_size, want->grid_size, want->max_players, want->max_hp, want->damage);
+}
+
+// -------- Spectators and Replay Playback --------
+// Index of the channel subscription held by a spectator socket, or -1.
+// Assumes state_lock is already held by the caller.
+int find_spectator_sub_locked(int sockfd) {
+    for (int i = 0; i < spectator_sub_count; ++i) {
+        if (spectator_subs[i].sockfd == sockfd) return i;
+    }
+    return -1;
+}
+
+// Move a spectator between the shared full-frame fan-out and its own
+// channel subscription, which the broadcaster sends inline.
+void subscribe_spectator(int sockfd, const char *args) {
+    pthread_mutex_lock(&state_lock);
+    int i = find_spectator_sub_locked(sockfd);
+    Subscription sub;
+    memset(&sub, 0, sizeof(sub));
+    sub.sockfd = sockfd;
+    if (i >= 0) sub = spectator_subs[i];
+    int ok = parse_subscription_locked(args, &sub) == 0;
+    if (ok && sub.mask && i < 0) {
+        if (spectator_sub_count < MAX_CHANNEL_SPECTATORS) {
+            fanout_remove(spectators, sockfd);
+            spectator_subs[spectator_sub_count++] = sub;
+        } else {
+            ok = 0;
+        }
+    } else if (ok && sub.mask) {
+        spectator_subs[i] = sub;
+    } else if (ok && i >= 0) {
+        // Back to full frames
+        spectator_subs[i] = spectator_subs[--spectator_sub_count];
+        ok = fanout_add(spectators, sockfd) == 0;
+    }
+    pthread_mutex_unlock(&state_lock);
+    if (ok) {
+        send_subscription_reply(sockfd, &sub);
+    } else {
+        const char *msg = "Usage: SUBSCRIBE <grid|positions|hp|events|terrain>[:<per-sec>] ... | SUBSCRIBE ALL\n";
+        send(sockfd, msg, strlen(msg), 0);
+    }
+}
+
+// Turn this connection into a live spectator until it quits or disconnects.
+void spectate_live(int sockfd) {
+    // Send the current state to this spectator only, then join the fan-out
+    // under the same lock hold so no broadcast falls in between
+    pthread_mutex_lock(&state_lock);
+    if (fanout_count(spectators) >= MAX_SPECTATORS) {
+        pthread_mutex_unlock(&state_lock);
+        const char *msg = "Too many spectators. Try again later.\n";
+        send(sockfd, msg, strlen(msg), 0);
+        return;
+    }
+    const char *msg = "Watching live match. Send QUIT to leave.\n";
+    send(sockfd, msg, strlen(msg), 0);
+    int len;
+    const char *state_msg = state_frame_locked(&len);
+    if (state_msg) send(sockfd, state_msg, len, 0);
+    int added = fanout_add(spectators, sockfd);
+    pthread_mutex_unlock(&state_lock);
+    if (added < 0) {
+        msg = "Too many spectators. Try again later.\n";
+        send(sockfd, msg, strlen(msg), 0);
+        return;
+    }
+
     char buffer[256];
-    // Notify this client of their symbol
-    char welcome_msg[64];
-    snprintf(welcome_msg, sizeof(welcome_msg), "Welcome to the game! You are player %c.\n", players[player_index].symbol);
-    send(sockfd, welcome_msg, strlen(welcome_msg), 0);
+    while (1) {
+        ssize_t n = recv(sockfd, buffer, sizeof(buffer) - 1, 0);
+        if (n <= 0) break;
+        buffer[n] = '\0';
+        char *newline = strpbrk(buffer, "\r\n");
+        if (newline) *newline = '\0';
+        if (strncasecmp(buffer, "QUIT", 4) == 0) break;
+        if (strncasecmp(buffer, "SUBSCRIBE", 9) == 0) subscribe_spectator(sockfd, buffer + 9);
+        if (strncasecmp(buffer, "CHUNK ", 6) == 0) send_chunks(sockfd, buffer + 6);
+    }
+
+    pthread_mutex_lock(&state_lock);
+    int i = find_spectator_sub_locked(sockfd);
+    if (i >= 0) spectator_subs[i] = spectator_subs[--spectator_sub_count];
+    pthread_mutex_unlock(&state_lock);
+    fanout_remove(spectators, sockfd);
+}
+
+// Stream a finished replay as ordinary state frames, paced by the recorded
+// tick times divided by speed. Frames carry the same Version:/Tick: header
+// as live ones (the version is the replay tick + 1, so it only grows) and
+// are rendered straight from the mmap'd file; no game state is touched and
+// no lock is taken.
+void stream_replay(int sockfd, const char *id, double speed, unsigned int from_tick) {
+    for (const char *c = id; *c; ++c) {
+        if (!isalnum((unsigned char)*c) && *c != '-') {
+            const char *msg = "Invalid replay id.\n";
+            send(sockfd, msg, strlen(msg), 0);
+            return;
+        }
+    }
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%s.rpl", REPLAY_DIR, id);
+    ReplayReader reader;
+    ReplayCursor cur;
+    if (replay_open(&reader, path) < 0) {
+        const char *msg = "No such replay.\n";
+        send(sockfd, msg, strlen(msg), 0);
+        return;
+    }
+    int grid_size = reader.header.grid_size;
+    int slots = reader.header.max_players;
+    int *cells = malloc(grid_size * grid_size * sizeof(int));
+    size_t cap = 32 + game_state_cap(grid_size, slots);
+    char *frame = malloc(cap);
+    Player *players = calloc(slots, sizeof(Player));
+    if (!cells || !frame || !players || replay_seek(&reader, &cur, from_tick) < 0) {
+        const char *msg = "Replay is empty or unreadable.\n";
+        send(sockfd, msg, strlen(msg), 0);
+        free(cells);
+        free(frame);
+        free(players);
+        replay_close(&reader);
+        return;
+    }
+    for (int i = 0; i < grid_size * grid_size; ++i) cells[i] = reader.obstacles[i];
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "Playing replay %s (%u ticks) at %.2gx speed.\n",
+             id, reader.tick_count, speed);
+    send(sockfd, msg, strlen(msg), 0);
+    uint32_t prev_ms = cur.time_ms;
+    do {
+        uint64_t wait_ns = (uint64_t)((cur.time_ms - prev_ms) * 1e6 / speed);
+        struct timespec ts = { wait_ns / 1000000000, wait_ns % 1000000000 };
+        nanosleep(&ts, NULL);
+        prev_ms = cur.time_ms;
+        for (int p = 0; p < slots; ++p) {
+            players[p].active = cur.players[p].active;
+            players[p].row = cur.players[p].row;
+            players[p].col = cur.players[p].col;
+            players[p].hp = cur.players[p].hp;
+        }
+        int len = snprintf(frame, cap, "Version: %lu\nTick: %lu\n",
+                           (unsigned long)cur.tick + 1, (unsigned long)cur.tick);
+        len += game_format_state(frame + len, cap - len, grid_size, cells, players, slots);
+        if (send(sockfd, frame, len, 0) < 0) break; // viewer went away
+    } while (replay_next(&reader, &cur) == 0);
+
+    const char *done = "Replay finished.\n";
+    send(sockfd, done, strlen(done), 0);
+    free(cells);
+    free(frame);
+    free(players);
+    replay_close(&reader);
+}
+
+// Serve a WATCH request: args is the text after "WATCH", either empty or
+// "LIVE" for the live match, or "<replay-id> [speed] [start-tick]".
+void serve_viewer(int sockfd, const char *args) {
+    char id[64] = "";
+    double speed = 1.0;
+    unsigned int from_tick = 0;
+    sscanf(args, "%63s %lf %u", id, &speed, &from_tick);
+    if (speed < 0.1) speed = 0.1;
+    if (speed > 64) speed = 64;
+    if (id[0] == '\0' || strcasecmp(id, "LIVE") == 0) {
+        spectate_live(sockfd);
+    } else {
+        stream_replay(sockfd, id, speed, from_tick);
+    }
+}
+
+// A full server still lets a dropped player back in and still takes
+// spectators: wait briefly for the connection's first line and accept it
+// only if it is a valid RESUME or a WATCH. Returns the resumed slot, or -1
+// once the connection is done (watched, or refused).
+int admit_when_full(int sockfd) {
+    struct pollfd pfd = { sockfd, POLLIN, 0 };
+    char buffer[256], token[64];
+    unsigned long last_version = 0;
+    if (poll(&pfd, 1, config_current()->resume_wait_ms) == 1) {
+        ssize_t n = recv(sockfd, buffer, sizeof(buffer) - 1, 0);
+        if (n > 0) {
+            buffer[n] = '\0';
+            char *newline = strpbrk(buffer, "\r\n");
+            if (newline) *newline = '\0';
+            if (strncasecmp(buffer, "RESUME", 6) == 0 &&
+                sscanf(buffer + 6, "%63s %lu", token, &last_version) >= 1) {
+                pthread_mutex_lock(&state_lock);
+                int slot = resume_session_locked(sockfd, token, last_version, -1);
+                pthread_mutex_unlock(&state_lock);
+                if (slot >= 0) return slot;
+            } else if (strncasecmp(buffer, "WATCH", 5) == 0) {
+                serve_viewer(sockfd, buffer + 5);
+                return -1;
+            }
+        }
+    }
+    // Refuse new connection
+    const char *msg = "Server full. Try again later.\n";
+    send(sockfd, msg, strlen(msg), 0);
+    return -1;
+}
+
+// -------- Client Handling --------
+// Serve one connection until it quits or disconnects. player_index is the
+// slot assigned on accept (already welcomed), or -1 if the server was full.
+// Runs on a pool worker; returns when the connection is closed.
+void serve_client(int sockfd, int player_index) {
+    char buffer[256];
+    if (player_index < 0) {
+        player_index = admit_when_full(sockfd);
+        if (player_index < 0) {
+            close(sockfd);
+            return;
+        }
+    }
+    // Token bucket for the per-client command rate limit
+    double tokens = config_current()->cmd_burst;
+    struct timespec last_refill;
+    clock_gettime(CLOCK_MONOTONIC, &last_refill);
+    Metric *m_limited = metric_register("commands_rate_limited_total", METRIC_COUNTER);
+    Metric *m_rewound = metric_register("attacks_rewound_total", METRIC_COUNTER);
+    Metric *m_chat = metric_register("chat_messages_total", METRIC_COUNTER);
+    Metric *m_chat_limited = metric_register("chat_rate_limited_total", METRIC_COUNTER);
+    double chat_tokens = config_current()->chat_burst;
+    struct timespec chat_refill;
+    clock_gettime(CLOCK_MONOTONIC, &chat_refill);
 
     // Main loop to receive and handle commands from this client
     while (1) {
@@ -118,15 +1790,18 @@ void *client_handler(void *arg) {
         if (n <= 0) {
             // If recv returns 0 or negative, the client disconnected or error occurred
             pthread_mutex_lock(&state_lock);
-            if (players[player_index].active) {
-                // The client disconnected unexpectedly (did not send QUIT)
-                // Remove player from the game
-                close(players[player_index].socket_fd);
-                players[player_index].socket_fd = -1;
-                players[player_index].active = 0;
-                player_count--;
-                // Notify other players that this player has left
-                broadcast_state_locked();
+            if (conn_fd[player_index] == sockfd && room->players[player_index].active) {
+                // The client disconnected unexpectedly (did not send QUIT).
+                // Keep the player on the board for a RESUME if sessions are
+                // on; otherwise remove them. The socket is closed below.
+                if (detach_player_locked(player_index)) {
+                    printf("Player %c dropped; session held for RESUME.\n", room_symbol(player_index));
+                } else {
+                    conn_fd[player_index] = -1;
+                    remove_player_locked(player_index);
+                    // Notify other players that this player has left
+                    broadcast_state_locked();
+                }
             }
             pthread_mutex_unlock(&state_lock);
             break;
@@ -137,6 +1812,24 @@ void *client_handler(void *arg) {
         char *newline = strpbrk(buffer, "\r\n");
         if (newline) *newline = '\0';
 
+        // Enforce the command rate limit from the live configuration
+        const Config *cfg = config_current();
+        if (cfg->cmd_rate > 0) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            tokens += ((now.tv_sec - last_refill.tv_sec) +
+                       (now.tv_nsec - last_refill.tv_nsec) / 1e9) * cfg->cmd_rate;
+            if (tokens > cfg->cmd_burst) tokens = cfg->cmd_burst;
+            last_refill = now;
+            if (tokens < 1) {
+                metric_add(m_limited, 1);
+                const char *msg = "Rate limit exceeded, command dropped.\n";
+                send(sockfd, msg, strlen(msg), 0);
+                continue;
+            }
+            tokens -= 1;
+        }
+
         // Parse and handle the command
         if (strncasecmp(buffer, "MOVE", 4) == 0) {
             // Format: MOVE <DIRECTION>
@@ -149,167 +1842,438 @@ void *client_handler(void *arg) {
             }
             // Normalize direction to uppercase
             for (char *d = direction; *d; ++d) *d = toupper(*d);
-            int newR = players[player_index].row;
-            int newC = players[player_index].col;
+            int dr = 0, dc = 0;
             if (strcmp(direction, "UP") == 0) {
-                newR -= 1;
+                dr = -1;
             } else if (strcmp(direction, "DOWN") == 0) {
-                newR += 1;
+                dr = 1;
             } else if (strcmp(direction, "LEFT") == 0) {
-                newC -= 1;
+                dc = -1;
             } else if (strcmp(direction, "RIGHT") == 0) {
-                newC += 1;
+                dc = 1;
             } else {
                 const char *msg = "Invalid direction. Use UP, DOWN, LEFT, or RIGHT.\n";
                 send(sockfd, msg, strlen(msg), 0);
                 continue;
             }
             // Attempt move within a locked state update
-            pthread_mutex_lock(&state_lock);
-            // Check bounds and obstacles/players
-            if (newR < 0 || newR >= GRID_SIZE || newC < 0 || newC >= GRID_SIZE) {
-                // Out of bounds
-                const char *msg = "Move blocked: out of bounds.\n";
-                send(sockfd, msg, strlen(msg), 0);
+            lock_for_command();
+            Cmd cmd = { CMD_MOVE, player_index, dr, dc, 0 };
+            RoomResult result = room_apply(room, &cmd, NULL);
+            if (result == RES_OK) {
+                // Broadcast new state to all players
+                broadcast_state_locked();
+            } else if (result != RES_INVALID) {
                 // No state change, no broadcast
-            } else if (obstacles[newR][newC] == 1) {
-                // Target cell has an obstacle
-                const char *msg = "Move blocked: obstacle in the way.\n";
+                const char *msg = result == RES_OUT_OF_BOUNDS ? "Move blocked: out of bounds.\n"
+                                : result == RES_OBSTACLE ? "Move blocked: obstacle in the way.\n"
+                                : "Move blocked: another player is in that cell.\n";
                 send(sockfd, msg, strlen(msg), 0);
-                // No state change
-            } else {
-                // Check if another player occupies the target cell
-                int occupied = 0;
-                for (int q = 0; q < MAX_PLAYERS; ++q) {
-                    if (players[q].active && q != player_index &&
-                        players[q].row == newR && players[q].col == newC) {
-                        occupied = 1;
-                        break;
-                    }
-                }
-                if (occupied) {
-                    const char *msg = "Move blocked: another player is in that cell.\n";
-                    send(sockfd, msg, strlen(msg), 0);
-                } else {
-                    // Move is valid, update player's position
-                    players[player_index].row = newR;
-                    players[player_index].col = newC;
-                    // Broadcast new state to all players
-                    broadcast_state_locked();
-                }
             }
             pthread_mutex_unlock(&state_lock);
-        } else if (strcasecmp(buffer, "ATTACK") == 0) {
-            pthread_mutex_lock(&state_lock);
+        } else if (strcasecmp(buffer, "ATTACK") == 0 || strncasecmp(buffer, "ATTACK ", 7) == 0) {
+            // Format: ATTACK [tick], where tick is the "Tick:" of the last
+            // frame the client saw; targets are judged where they stood then
+            unsigned long seen_tick;
+            int has_tick = sscanf(buffer + 6, "%lu", &seen_tick) == 1;
+            lock_for_command();
             // Determine if any adjacent players exist and apply damage
-            int attackerR = players[player_index].row;
-            int attackerC = players[player_index].col;
-            int hit = 0;
-            for (int q = 0; q < MAX_PLAYERS; ++q) {
-                if (players[q].active && q != player_index) {
-                    int dr = players[q].row - attackerR;
-                    int dc = players[q].col - attackerC;
-                    // Check adjacency (Manhattan distance 1)
-                    if ((abs(dr) == 1 && dc == 0) || (abs(dc) == 1 && dr == 0)) {
-                        // Adjacent player found
-                        players[q].hp -= DAMAGE;
-                        if (players[q].hp <= 0) {
-                            // Player is dead, remove them from game
-                            players[q].hp = 0;
-                            close(players[q].socket_fd);
-                            players[q].socket_fd = -1;
-                            players[q].active = 0;
-                            player_count--;
-                        }
-                        hit = 1;
-                    }
-                }
+            Cmd cmd = { CMD_ATTACK, player_index, 0, 0, 0 };
+            if (has_tick && seen_tick < room->tick) {
+                unsigned long behind = room->tick - seen_tick;
+                int cap = config_current()->rewind_ticks;
+                cmd.rewind = behind < (unsigned long)cap ? (int)behind : cap;
+                if (cmd.rewind > 0) metric_add(m_rewound, 1);
             }
-            if (!hit) {
+            EventList events = { .count = 0 };
+            RoomResult result = room_apply(room, &cmd, &events);
+            handle_events_locked(&events);
+            if (result == RES_NO_TARGET) {
                 // No adjacent players, send a message to attacker only (no state change)
                 const char *msg = "No targets adjacent to attack.\n";
                 send(sockfd, msg, strlen(msg), 0);
-            } else {
+            } else if (result == RES_OK) {
                 // At least one player was hit or removed, broadcast updated state
                 broadcast_state_locked();
             }
             pthread_mutex_unlock(&state_lock);
+        } else if (strncasecmp(buffer, "WATCH", 5) == 0) {
+            // Format: WATCH [<replay-id> [speed] [start-tick]]
+            // Without an id the client spectates the live match.
+            // Give up the player slot; the socket now belongs to the viewer
+            pthread_mutex_lock(&state_lock);
+            if (conn_fd[player_index] == sockfd && room->players[player_index].active) {
+                conn_fd[player_index] = -1;
+                remove_player_locked(player_index);
+                broadcast_state_locked();
+            }
+            pthread_mutex_unlock(&state_lock);
+            serve_viewer(sockfd, buffer + 5);
+            break;
+        } else if (strncasecmp(buffer, "RESUME", 6) == 0) {
+            // Format: RESUME <token> [last_version]
+            char token[64];
+            unsigned long last_version = 0;
+            if (sscanf(buffer + 6, "%63s %lu", token, &last_version) < 1) {
+                const char *msg = "Usage: RESUME <token> [last_version]\n";
+                send(sockfd, msg, strlen(msg), 0);
+                continue;
+            }
+            pthread_mutex_lock(&state_lock);
+            int slot = resume_session_locked(sockfd, token, last_version, player_index);
+            if (slot >= 0) player_index = slot;
+            pthread_mutex_unlock(&state_lock);
+        } else if (strncasecmp(buffer, "SUBSCRIBE", 9) == 0) {
+            // Format: SUBSCRIBE <channel>[:<per-sec>] ... | SUBSCRIBE ALL
+            pthread_mutex_lock(&state_lock);
+            int ok = conn_fd[player_index] == sockfd &&
+                     parse_subscription_locked(buffer + 9, &player_sub[player_index]) == 0;
+            Subscription sub = player_sub[player_index];
+            pthread_mutex_unlock(&state_lock);
+            if (ok) {
+                send_subscription_reply(sockfd, &sub);
+            } else {
+                const char *msg = "Usage: SUBSCRIBE <grid|positions|hp|events|terrain>[:<per-sec>] ... | SUBSCRIBE ALL\n";
+                send(sockfd, msg, strlen(msg), 0);
+            }
+        } else if (strncasecmp(buffer, "CHUNK ", 6) == 0) {
+            // Format: CHUNK <index> [<index> ...], for terrain subscribers
+            send_chunks(sockfd, buffer + 6);
+        } else if (strncasecmp(buffer, "SAY ", 4) == 0 || strncasecmp(buffer, "TEAM ", 5) == 0) {
+            // Format: SAY <text> (whole room) | TEAM <text> (own team)
+            int team_only = toupper(buffer[0]) == 'T';
+            char *text = buffer + (team_only ? 5 : 4);
+            for (char *ch = text; *ch; ++ch) {
+                if (!isprint((unsigned char)*ch)) *ch = '?';
+            }
+            // Chat has its own, tighter per-sender budget
+            if (cfg->chat_rate > 0) {
+                struct timespec now;
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                chat_tokens += ((now.tv_sec - chat_refill.tv_sec) +
+                                (now.tv_nsec - chat_refill.tv_nsec) / 1e9) * cfg->chat_rate;
+                if (chat_tokens > cfg->chat_burst) chat_tokens = cfg->chat_burst;
+                chat_refill = now;
+                if (chat_tokens < 1) {
+                    metric_add(m_chat_limited, 1);
+                    const char *msg = "Chat rate limit exceeded, message dropped.\n";
+                    send(sockfd, msg, strlen(msg), 0);
+                    continue;
+                }
+                chat_tokens -= 1;
+            }
+            lock_for_command();
+            int ok = *text && conn_fd[player_index] == sockfd &&
+                     post_chat_locked(player_index, team_only, text) == 0;
+            pthread_mutex_unlock(&state_lock);
+            if (ok) {
+                metric_add(m_chat, 1);
+            } else {
+                const char *msg = *text ? "Chat is busy, message dropped.\n" : "Usage: SAY <text> | TEAM <text>\n";
+                send(sockfd, msg, strlen(msg), 0);
+            }
+        } else if (strcasecmp(buffer, "STATS") == 0) {
+            char stats[2048];
+            int len = metrics_format(stats, sizeof(stats));
+            send(sockfd, stats, len, 0);
         } else if (strcasecmp(buffer, "QUIT") == 0) {
             // Client wants to quit the game
             pthread_mutex_lock(&state_lock);
             // Remove this player from the game
-            close(players[player_index].socket_fd);
-            players[player_index].socket_fd = -1;
-            players[player_index].active = 0;
-            player_count--;
-            // Broadcast updated state to others
-            broadcast_state_locked();
+            if (conn_fd[player_index] == sockfd && room->players[player_index].active) {
+                conn_fd[player_index] = -1;
+                remove_player_locked(player_index);
+                // Broadcast updated state to others
+                broadcast_state_locked();
+            }
             pthread_mutex_unlock(&state_lock);
             break; // break out of the loop to terminate thread
         } else {
             // Unknown command
-            const char *msg = "Unknown command. Available commands: MOVE, ATTACK, QUIT.\n";
+            const char *msg = "Unknown command. Available commands: MOVE, ATTACK, SAY, TEAM, WATCH, RESUME, SUBSCRIBE, CHUNK, STATS, QUIT.\n";
             send(sockfd, msg, strlen(msg), 0);
         }
     } // end of command handling loop
 
     // Cleanup: If loop ended, ensure this player's resources are cleaned up (if not already)
     pthread_mutex_lock(&state_lock);
-    if (players[player_index].active) {
-        // Make sure to remove player if still marked active (for safety)
-        players[player_index].active = 0;
-        player_count--;
+    if (conn_fd[player_index] == sockfd && room->players[player_index].active) {
+        // Make sure to remove player if still marked active (for safety).
+        // The slot may already belong to someone else after QUIT or WATCH.
+        conn_fd[player_index] = -1;
+        remove_player_locked(player_index);
     }
     pthread_mutex_unlock(&state_lock);
     close(sockfd);
-    fprintf(stderr, "Player %c disconnected, thread terminating.\n", players[player_index].symbol);
-    pthread_exit(NULL);
+    fprintf(stderr, "Player %c disconnected.\n", room_symbol(player_index));
+}
+
+// -------- Worker Pool --------
+// Connections are served by pre-spawned worker threads instead of a fresh
+// thread per accept. The accept thread only queues the socket; a worker is
+// created on demand when every existing one is busy, and workers beyond
+// WORKERS_PRESPAWN exit once they go idle again after a connection storm.
+void *worker_thread(void *arg) {
+    (void) arg;
+    Metric *m_workers = metric_register("workers_total", METRIC_GAUGE);
+    pthread_mutex_lock(&pool_lock);
+    while (1) {
+        // Every idle worker claims exactly one queued connection
+        idle_workers++;
+        while (work_count == 0) {
+            pthread_cond_wait(&pool_cond, &pool_lock);
+        }
+        idle_workers--;
+        HandlerArgs job = work_queue[work_head];
+        work_head = (work_head + 1) % WORK_QUEUE_LEN;
+        work_count--;
+        pthread_mutex_unlock(&pool_lock);
+
+        serve_client(job.sockfd, job.slot);
+
+        pthread_mutex_lock(&pool_lock);
+        if (idle_workers >= WORKERS_PRESPAWN) break;
+    }
+    total_workers--;
+    metric_set(m_workers, total_workers);
+    pthread_mutex_unlock(&pool_lock);
     return NULL;
 }
 
+// Start one more worker. Assumes pool_lock is held. Returns 0 on success.
+int spawn_worker_locked() {
+    pthread_t thread_id;
+    if (pthread_create(&thread_id, NULL, worker_thread, NULL) != 0) return -1;
+    pthread_detach(thread_id);
+    total_workers++;
+    metric_set(metric_register("workers_total", METRIC_GAUGE), total_workers);
+    return 0;
+}
+
+void start_workers() {
+    pthread_mutex_lock(&pool_lock);
+    for (int i = 0; i < WORKERS_PRESPAWN; ++i) {
+        if (spawn_worker_locked() < 0) {
+            perror("Could not create worker thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+    pthread_mutex_unlock(&pool_lock);
+}
+
+// Hand a connection to the pool. Returns -1 if it could not be queued.
+int dispatch_client(int sockfd, int slot) {
+    pthread_mutex_lock(&pool_lock);
+    if (work_count == WORK_QUEUE_LEN) {
+        pthread_mutex_unlock(&pool_lock);
+        return -1;
+    }
+    work_queue[(work_head + work_count) % WORK_QUEUE_LEN] = (HandlerArgs){ sockfd, slot };
+    work_count++;
+    // More queued connections than waiting workers: grow the pool
+    if (work_count > idle_workers && spawn_worker_locked() < 0) {
+        perror("Could not create worker thread");
+    }
+    pthread_cond_signal(&pool_cond);
+    pthread_mutex_unlock(&pool_lock);
+    return 0;
+}
+
+// -------- Accept Path --------
+Metric *m_accepts, *m_batch_max, *m_deferred, *m_coalesced;   // registered in main()
+
+// Admit every connection from one accept batch under a single state_lock
+// hold: make room by evicting bots, place all new players in one pass over
+// the free cells, register their sessions and send the welcomes. The state
+// broadcast is left to flush_join_broadcast() so a join storm is announced
+// once per window. The sockets are handed to workers after the lock is
+// released. Returns the number of players that joined.
+int admit_batch(const int *fds, int count) {
+    int slots[ACCEPT_BATCH];
+    pthread_mutex_lock(&state_lock);
+    refresh_room_locked();
+    // Limit concurrent clients to the room's player slots
+    int free_slots = room->params.max_players - room->player_count;
+    while (free_slots < count && evict_bot_locked()) free_slots++;
+    int joined = room_spawn_batch(room, count < free_slots ? count : free_slots, 0, slots, NULL);
+    for (int i = 0; i < count; ++i) {
+        if (i >= joined) {
+            slots[i] = -1; // full: the worker accepts only a RESUME, then refuses
+            continue;
+        }
+        int idx = slots[i];
+        conn_fd[idx] = fds[i];
+        new_session_locked(idx);
+        // Notify this client of their symbol and session token before any state
+        char welcome_msg[128];
+        int len = snprintf(welcome_msg, sizeof(welcome_msg),
+                           "Welcome to the game! You are player %c.\nSession: %s\n",
+                           room_symbol(idx), session_token[idx]);
+        send(fds[i], welcome_msg, len, MSG_DONTWAIT);
+        printf("New player %c joined at position (%d,%d).\n", room_symbol(idx),
+               room->players[idx].row, room->players[idx].col);
+    }
+    pthread_mutex_unlock(&state_lock);
+
+    metric_add(m_accepts, count);
+    if (count > metric_get(m_batch_max)) metric_set(m_batch_max, count);
+
+    for (int i = 0; i < count; ++i) {
+        if (dispatch_client(fds[i], slots[i]) == 0) continue;
+        // Could not queue: release the slot and drop the connection
+        pthread_mutex_lock(&state_lock);
+        if (slots[i] >= 0 && conn_fd[slots[i]] == fds[i]) {
+            conn_fd[slots[i]] = -1;
+            remove_player_locked(slots[i]);
+        }
+        pthread_mutex_unlock(&state_lock);
+        close(fds[i]);
+    }
+    return joined;
+}
+
+// Broadcast the state after one or more join batches, unless another
+// broadcast (a move, a leave, the room tick) already carried this version.
+// joins is the number of players admitted since the last flush.
+void flush_join_broadcast(int joins) {
+    pthread_mutex_lock(&state_lock);
+    int sent = history_count > 0 &&
+               history[(history_count - 1) % HISTORY_LEN].version == room->version;
+    if (!sent) broadcast_state_locked();
+    pthread_mutex_unlock(&state_lock);
+    if (joins > 1) {
+        metric_add(m_coalesced, joins - 1);
+    }
+}
+
 // -------- Main Server Setup and Loop --------
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <port>\n", argv[0]);
+    int opt;
+    double headless_seconds = 0;
+    const char *mcast_group = NULL, *mcast_iface = NULL;
+    // Ignore SIGPIPE to prevent crashes on send to disconnected clients
+    signal(SIGPIPE, SIG_IGN);
+    // Block SIGHUP before any thread exists, so every thread inherits the
+    // mask and config_thread is the only one that picks it up (sigwait())
+    sigset_t hup;
+    sigemptyset(&hup);
+    sigaddset(&hup, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &hup, NULL);
+    config_defaults(&base_config);
+    while ((opt = getopt(argc, argv, "c:b:B:H:f:m:I:C:")) != -1) {
+        switch (opt) {
+        case 'c':
+            config_path = optarg;
+            break;
+        case 'b':
+            base_config.bots = atoi(optarg);
+            if (base_config.bots < 0 || base_config.bots >= base_config.room.max_players) {
+                fprintf(stderr, "Bot count must be between 0 and %d.\n", base_config.room.max_players - 1);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'B':
+            // Benchmark the bot decision kernels and exit
+            bots_benchmark(atoi(optarg) > 0 ? atoi(optarg) : 1000, stdout);
+            exit(EXIT_SUCCESS);
+        case 'H':
+            headless_seconds = atof(optarg);
+            break;
+        case 'm':
+            mcast_group = optarg;
+            break;
+        case 'I':
+            mcast_iface = optarg;
+            break;
+        case 'C':
+            checkpoint_path = optarg;
+            break;
+        case 'f':
+            fanout_threads = atoi(optarg);
+            if (fanout_threads < 0 || fanout_threads > 64) {
+                fprintf(stderr, "Fan-out thread count must be between 0 and 64.\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-c config] [-b bots] [-f fanout-threads] [-C checkpoint-log] [-m group:port [-I iface]] [-B bench-bots] [-H seconds] <port>\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (argc - optind != 1 && headless_seconds <= 0) {
+        fprintf(stderr, "Usage: %s [-c config] [-b bots] [-f fanout-threads] [-C checkpoint-log] [-m group:port [-I iface]] [-B bench-bots] [-H seconds] <port>\n", argv[0]);
         exit(EXIT_FAILURE);
     }
-    int port = atoi(argv[1]);
+    int port = headless_seconds > 0 ? 1 : atoi(argv[optind]);
     if (port <= 0) {
         fprintf(stderr, "Invalid port number.\n");
         exit(EXIT_FAILURE);
     }
+    if (config_path) {
+        if (reload_config() < 0) exit(EXIT_FAILURE);
+    } else {
+        Config *cfg = malloc(sizeof(*cfg));
+        *cfg = base_config;
+        config_publish(cfg);
+    }
 
     int server_fd, client_fd;
     struct sockaddr_in server_addr, client_addr;
     socklen_t client_len = sizeof(client_addr);
     pthread_t thread_id;
 
+    if (headless_seconds > 0) {
+        run_headless(&config_current()->room, headless_seconds);
+        exit(EXIT_SUCCESS);
+    }
+
     // Initialize game state and mutex
-    srand(time(NULL));
     pthread_mutex_init(&state_lock, NULL);
-    // Initialize players and obstacles
-    for (int i = 0; i < MAX_PLAYERS; ++i) {
-        players[i].active = 0;
-        players[i].socket_fd = -1;
-        players[i].symbol = 'A' + i; // pre-assign symbols based on index
-        players[i].hp = 0;
-        players[i].row = players[i].col = 0;
-    }
-    // Place random obstacles on the grid
-    memset(obstacles, 0, sizeof(obstacles));
-    int obstacle_count = 3 + rand() % 3; // 3 to 5 obstacles
-    for (int k = 0; k < obstacle_count; ++k) {
-        int r = rand() % GRID_SIZE;
-        int c = rand() % GRID_SIZE;
-        if (obstacles[r][c] == 1) {
-            k--; // already an obstacle here, try again
-        } else {
-            obstacles[r][c] = 1;
-        }
+    for (int i = 0; i < ROOM_MAX_PLAYERS; ++i) {
+        conn_fd[i] = -1;
+    }
+    room = room_create(&config_current()->room, time(NULL));
+    if (!room) {
+        fprintf(stderr, "Could not create the game room.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (checkpoint_path) restore_checkpoint_locked();
+    m_chunks_announced = metric_register("terrain_chunks_announced_total", METRIC_COUNTER);
+    m_chunks_sent = metric_register("terrain_chunks_sent_total", METRIC_COUNTER);
+    m_events = metric_register("events_total", METRIC_COUNTER);
+    m_frames_shed = metric_register("spectator_frames_shed_total", METRIC_COUNTER);
+    m_overload_level = metric_register("overload_level", METRIC_GAUGE);
+    m_tick_lag = metric_register("tick_lag_ms", METRIC_GAUGE);
+    m_rss = metric_register("rss_mb", METRIC_GAUGE);
+    m_headroom = metric_register("cpu_headroom_percent", METRIC_GAUGE);
+    m_waiting = metric_register("commands_waiting", METRIC_GAUGE);
+    m_tick_cost = metric_register("tick_cost_ns", METRIC_GAUGE);
+    m_tick_adjust = metric_register("tick_adjustments_total", METRIC_COUNTER);
+    m_tick_period = metric_register("tick_period_ms", METRIC_GAUGE);
+    m_accepts = metric_register("accepts_total", METRIC_COUNTER);
+    m_batch_max = metric_register("accept_batch_max", METRIC_GAUGE);
+    m_deferred = metric_register("joins_deferred_total", METRIC_COUNTER);
+    m_coalesced = metric_register("join_broadcasts_coalesced_total", METRIC_COUNTER);
+    swap_rules_locked();
+    if (mcast_group) mcast_open(mcast_group, mcast_iface);
+    spectators = fanout_create(fanout_threads, MAX_SPECTATORS);
+    if (!spectators) {
+        fprintf(stderr, "Could not start the spectator fan-out threads.\n");
+        exit(EXIT_FAILURE);
     }
 
-    // Ignore SIGPIPE to prevent crashes on send to disconnected clients
-    signal(SIGPIPE, SIG_IGN);
+    if (mkdir(REPLAY_DIR, 0755) < 0 && errno != EEXIST) {
+        perror("Could not create replay directory");
+    }
+    if (metrics_log_start(METRICS_DIR) < 0) {
+        fprintf(stderr, "Could not start the metrics recorder.\n");
+    }
+
+    if (pthread_create(&thread_id, NULL, config_thread, NULL) != 0) {
+        perror("Could not create config thread");
+        exit(EXIT_FAILURE);
+    }
+    pthread_detach(thread_id);
 
     // Create TCP socket
     if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
@@ -331,80 +2295,99 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
 
-    // Listen for incoming connections (backlog up to 4)
-    if (listen(server_fd, 4) < 0) {
+    // Listen for incoming connections. The backlog absorbs reconnect storms;
+    // the socket is non-blocking so the accept loop can drain it in batches.
+    if (listen(server_fd, LISTEN_BACKLOG) < 0 || fcntl(server_fd, F_SETFL, O_NONBLOCK) < 0) {
         perror("Listen failed");
         close(server_fd);
         exit(EXIT_FAILURE);
     }
     printf("Server started on port %d. Waiting for players...\n", port);
 
-    // Accept loop
+    if (checkpoint_path) {
+        CheckpointLog *log = checkpoint_open(checkpoint_path);
+        if (!log || pthread_create(&thread_id, NULL, checkpoint_thread, log) != 0) {
+            perror("Could not create checkpoint thread");
+            exit(EXIT_FAILURE);
+        }
+        pthread_detach(thread_id);
+        printf("Checkpointing the world to %s every %d ms.\n", checkpoint_path, config_current()->checkpoint_ms);
+    }
+
+    // The room tick drives server-side bots; it always runs so a reload can add bots
+    printf("Bots: %d, decision kernel: %s.\n", config_current()->bots, bots_kernel_name());
+    if (pthread_create(&thread_id, NULL, bot_tick_thread, NULL) != 0) {
+        perror("Could not create room tick thread");
+        exit(EXIT_FAILURE);
+    }
+    pthread_detach(thread_id);
+
+    // Accept loop: wait for the listening socket and drain every pending
+    // connection into one batch. New players are welcomed immediately, but
+    // the state broadcast announcing them goes out at most once per
+    // join_window_ms, so a join storm costs one fan-out per window instead
+    // of one per join.
+    struct timespec last_flush = { 0, 0 }, last_admit = { 0, 0 }, now;
+    int pending_joins = 0;
+    start_workers();
     while (1) {
-        client_fd = accept(server_fd, (struct sockaddr*)&client_addr, &client_len);
-        if (client_fd < 0) {
-            perror("Accept failed");
-            continue;
+        int window_ms = config_current()->join_window_ms;
+        int timeout = -1;
+        if (pending_joins > 0) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            long since = (now.tv_sec - last_flush.tv_sec) * 1000 +
+                         (now.tv_nsec - last_flush.tv_nsec) / 1000000;
+            timeout = since >= window_ms ? 0 : (int)(window_ms - since);
         }
-        // Limit concurrent clients to MAX_PLAYERS
-        pthread_mutex_lock(&state_lock);
-        if (player_count >= MAX_PLAYERS) {
-            pthread_mutex_unlock(&state_lock);
-            // Refuse new connection
-            const char *msg = "Server full. Try again later.\n";
-            send(client_fd, msg, strlen(msg), 0);
-            close(client_fd);
-            continue;
+        // While joins are deferred, new connections wait in the listen
+        // backlog and are admitted DEFERRED_JOIN_BATCH at a time, so admission
+        // does not compete with players' commands for state_lock
+        int limit = ACCEPT_BATCH;
+        if (atomic_load(&overload_level) >= LOAD_DEFER_JOINS) {
+            limit = DEFERRED_JOIN_BATCH;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            long since = (now.tv_sec - last_admit.tv_sec) * 1000 +
+                         (now.tv_nsec - last_admit.tv_nsec) / 1000000;
+            if (since < DEFERRED_JOIN_MS) {
+                int wait = DEFERRED_JOIN_MS - since;
+                poll(NULL, 0, timeout >= 0 && timeout < wait ? timeout : wait);
+                limit = 0;
+            }
         }
-        // Find an available player slot
-        int idx = -1;
-        for (int i = 0; i < MAX_PLAYERS; ++i) {
-            if (!players[i].active) {
-                idx = i;
+        struct pollfd pfd = { server_fd, POLLIN, 0 };
+        if (limit > 0 && poll(&pfd, 1, timeout) < 0 && errno != EINTR) {
+            perror("Poll failed");
+        }
+        int batch[ACCEPT_BATCH];
+        int count = 0;
+        while (count < limit) {
+            client_fd = accept(server_fd, (struct sockaddr*)&client_addr, &client_len);
+            if (client_fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) perror("Accept failed");
                 break;
             }
+            batch[count++] = client_fd;
         }
-        if (idx == -1) {
-            // This should not happen if player_count was accurate, but handle gracefully
-            pthread_mutex_unlock(&state_lock);
-            const char *msg = "Server error: no slot available.\n";
-            send(client_fd, msg, strlen(msg), 0);
-            close(client_fd);
-            continue;
+        if (count > 0) {
+            pending_joins += admit_batch(batch, count);
+            clock_gettime(CLOCK_MONOTONIC, &last_admit);
+            if (limit < ACCEPT_BATCH) metric_add(m_deferred, count);
         }
-        // Initialize the new player slot
-        players[idx].active = 1;
-        players[idx].socket_fd = client_fd;
-        players[idx].hp = MAX_HP;
-        // Find a random free position (not an obstacle and not occupied by another player)
-        do {
-            players[idx].row = rand() % GRID_SIZE;
-            players[idx].col = rand() % GRID_SIZE;
-        } while (obstacles[players[idx].row][players[idx].col] == 1 || 
-                 ({ int occupied=0; for(int j=0;j<MAX_PLAYERS;j++){ if(players[j].active && j!=idx && players[j].row==players[idx].row && players[j].col==players[idx].col) { occupied=1; break; } } occupied; }));
-        player_count++;
-        printf("New player %c joined at position (%d,%d).\n", players[idx].symbol, players[idx].row, players[idx].col);
-        // Broadcast updated game state to all clients (including the new one)
-        broadcast_state_locked();
-        pthread_mutex_unlock(&state_lock);
-
-        // Create a detached thread for the new client
-        if (pthread_create(&thread_id, NULL, client_handler, (void*)(intptr_t)idx) != 0) {
-            perror("Could not create thread for new client");
-            // If thread creation fails, cleanup the allocated slot
-            pthread_mutex_lock(&state_lock);
-            close(players[idx].socket_fd);
-            players[idx].socket_fd = -1;
-            players[idx].active = 0;
-            player_count--;
-            pthread_mutex_unlock(&state_lock);
-            continue;
+        if (pending_joins == 0) continue;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long since = (now.tv_sec - last_flush.tv_sec) * 1000 +
+                     (now.tv_nsec - last_flush.tv_nsec) / 1000000;
+        if (since >= window_ms) {
+            flush_join_broadcast(pending_joins);
+            pending_joins = 0;
+            last_flush = now;
         }
-        pthread_detach(thread_id);
     }
 
     // Cleanup (unreachable in infinite loop unless we break out)
     close(server_fd);
+    room_destroy(room);
     pthread_mutex_destroy(&state_lock);
     return 0;
 }
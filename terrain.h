@@ -0,0 +1,46 @@
+/*
+ * Terrain chunks: the obstacle map cut into TERRAIN_CHUNK x TERRAIN_CHUNK
+ * blocks and addressed by content hash, so a client downloads each distinct
+ * block of terrain once and keeps it across sessions.
+ *
+ * Protocol (text, one item per line), for a client that subscribed to the
+ * "terrain" channel:
+ *
+ *   server: Terrain: <grid_size> <generation>     the map (re)starts; forget
+ *                                                 what was announced so far
+ *   server: Chunk: <index> <hash>                 chunk <index> entered your
+ *                                                 view and holds <hash>
+ *   client: CHUNK <index> [<index> ...]           send me these chunks
+ *   server: ChunkData: <index> <hash> <bits>      the chunk's content
+ *
+ * Chunks are numbered row-major, ceil(grid_size / TERRAIN_CHUNK) per row.
+ * <hash> is terrain_chunk_hash() in 16 hex digits and <bits> is the
+ * TERRAIN_CHUNK_BYTES bitmap in hex: bit r * TERRAIN_CHUNK + c (LSB first
+ * within each byte) is set when cell (r, c) of the chunk is an obstacle.
+ * Cells past the edge of the map are 0. A chunk is announced once per
+ * generation, when it first comes within the client's view, and the client
+ * only asks for hashes it has not cached; a known map costs no terrain bytes
+ * beyond the announcements.
+ */
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TERRAIN_CHUNK 32
+#define TERRAIN_CHUNK_BYTES (TERRAIN_CHUNK * TERRAIN_CHUNK / 8)
+#define TERRAIN_MAX_CHUNKS ((1024 / TERRAIN_CHUNK) * (1024 / TERRAIN_CHUNK))
+#define TERRAIN_FETCH_MAX 32     // chunk indices per CHUNK request
+
+// FNV-1a/64 of a chunk bitmap. Never 0, so 0 can mean "no chunk".
+static inline uint64_t terrain_chunk_hash(const uint8_t *bits) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < TERRAIN_CHUNK_BYTES; ++i) {
+        h ^= bits[i];
+        h *= 1099511628211ULL;
+    }
+    return h ? h : 1;
+}
+
+#endif